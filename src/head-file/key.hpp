@@ -14,12 +14,15 @@ struct Key {
         memset(index, 0, sizeof(index));
     }
 
+    //chars after the string are zero, so equal keys have equal bytes (e.g. in an export file)
+    //a longer id is cut, index always ends with a zero
     Key(char *id, const int &value = 0) : value(value) {
-        strcpy(index, id);
+        strncpy(index, id, sizeof(index) - 1);
+        index[sizeof(index) - 1] = '\0';
     }
 
     Key(const Key &other) {
-        strcpy(index, other.index);
+        memcpy(index, other.index, sizeof(index));
         value = other.value;
     }
 
@@ -67,4 +70,99 @@ struct cmp2 {
     }
 };
 
+/*
+ * key on an interned index, see Dictionary
+ * (id,value) is packed into one integer, so comparing is a single compare
+ * ids are in order of arrival: indexes are ordered by id, not by string
+ */
+struct IdKey {
+    unsigned int id = 0;
+    int value = 0;
+
+    IdKey() = default;
+
+    IdKey(const unsigned int &id, const int &value = 0) : id(id), value(value) {}
+
+    int GetVal() const {
+        return value;
+    }
+
+    //value is shifted to unsigned so that the order of int is kept
+    unsigned long long Packed() const {
+        return (unsigned long long) id << 32 | ((unsigned int) value ^ 0x80000000u);
+    }
+
+    bool operator<(const IdKey &other) const {
+        return Packed() < other.Packed();
+    }
+
+    bool operator==(const IdKey &other) const {
+        return Packed() == other.Packed();
+    }
+
+    bool operator<=(const IdKey &other) const {
+        return Packed() <= other.Packed();
+    }
+};
+
+//关于IdKey的compare类，同cmp1,cmp2
+struct id_cmp1 {
+    bool operator()(const IdKey &a, const IdKey &b) const {
+        return a.Packed() < b.Packed();
+    }
+};
+
+struct id_cmp2 {
+    bool operator()(const IdKey &a, const IdKey &b) const {
+        return a.id < b.id;
+    }
+};
+
+/*
+ * composite integer key (first,second), packed into one integer like IdKey
+ * e.g. (user id, timestamp), compare only first to get all the seconds of a first
+ */
+struct IntPairKey {
+    int first = 0;
+    int second = 0;
+
+    IntPairKey() = default;
+
+    IntPairKey(const int &first, const int &second = 0) : first(first), second(second) {}
+
+    int GetVal() const {
+        return second;
+    }
+
+    //both are shifted to unsigned so that the order of int is kept
+    unsigned long long Packed() const {
+        return (unsigned long long) ((unsigned int) first ^ 0x80000000u) << 32 |
+               ((unsigned int) second ^ 0x80000000u);
+    }
+
+    bool operator<(const IntPairKey &other) const {
+        return Packed() < other.Packed();
+    }
+
+    bool operator==(const IntPairKey &other) const {
+        return Packed() == other.Packed();
+    }
+
+    bool operator<=(const IntPairKey &other) const {
+        return Packed() <= other.Packed();
+    }
+};
+
+struct pair_cmp1 {
+    bool operator()(const IntPairKey &a, const IntPairKey &b) const {
+        return a.Packed() < b.Packed();
+    }
+};
+
+struct pair_cmp2 {
+    bool operator()(const IntPairKey &a, const IntPairKey &b) const {
+        return a.first < b.first;
+    }
+};
+
 #endif //BPLUSTREE_KEY_HPP
@@ -2,6 +2,9 @@
 #include "head-file/key.hpp"
 //#include "utility/bpt.hpp"
 #include "utility/BPlusTree.hpp"
+#include "utility/fast_io.hpp"
+#include "utility/server.hpp"
+#include "utility/trace.hpp"
 
 using namespace std;
 
@@ -22,50 +25,66 @@ bool print(sjtu::vector<long> vec, const string &str) {
     return true;
 }
 
-int main() {
+int main(int argc, char **argv) {
 //    freopen("my.out", "w", stdout);
+    //code [--record trace] [--serve path]
+    const char *serve_path = nullptr, *trace_name = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--serve")) serve_path = argv[i + 1];
+        else if (!strcmp(argv[i], "--record")) trace_name = argv[i + 1];
+    }
     BPlusTree<Key, int> tree("my_file", "list_file");
-    //将iostream和stdio解绑
-    ios_base::sync_with_stdio(false);
-    //将输入输出流解绑
-    cin.tie(nullptr);
-    cout.tie(nullptr);
-    int n;
-    int cnt = 0;
-    cin >> n;
-    string cmd;
+    //every insert, delete and find, to be run again by replay
+    TraceWriter *trace = trace_name ? new TraceWriter(trace_name) : nullptr;
+    //answer requests on a unix socket until stopped, see server.hpp
+    if (serve_path) {
+        Server server(tree, serve_path, trace);
+        bool served = server.Run();
+        delete trace;
+        if (!served) {
+            cerr << "can't serve on " << serve_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    //read and write stdin and stdout in large blocks, not through iostream
+    FastInput input;
+    FastOutput output;
+    int n = 0;
+    input.Number(n);
+    char cmd[16];
     char index[64];
     int value;
     while (n--) {
-        ++cnt;
-        cin >> cmd;
-        cin >> index;
-        if (cmd == "insert") {
-            cin >> value;
+        if (!input.Token(cmd, sizeof(cmd))) break;//end of input
+        input.Token(index, sizeof(index));
+        if (!strcmp(cmd, "insert")) {
+            input.Number(value);
+            if (trace) trace->Put(trace_insert, index, value);
             Key key(index, value);
             tree.Insert(key, value);
         }
-        if (cmd == "delete") {
-            cin >> value;
+        if (!strcmp(cmd, "delete")) {
+            input.Number(value);
+            if (trace) trace->Put(trace_delete, index, value);
             Key key(index, value);
             tree.Delete(key);
         }
-        if (cmd == "find") {
+        if (!strcmp(cmd, "find")) {
+            if (trace) trace->Put(trace_find, index, 0);
             Key key(index);
-            sjtu::vector<int> vec;
-            tree.Find(key, weak, vec);
-//            bool flag = print(vec, "list_file");
-//            if (!flag) cout << "null";
-            if (vec.empty()) cout << "null";
-            else {
-                int size = vec.size();
-                for (int i = 0; i < size; ++i) {
-                    cout << vec[i] << ' ';
-                }
-            }
-
-            std::cout << "\n";
+            bool found = false;
+            //print straight from the block
+            tree.Find(key, weak, [&found, &output](const Key &, const int &value) {
+                output.Number(value);
+                output.Put(' ');
+                found = true;
+                return true;
+            });
+            if (!found) output.Put("null");
+            output.Put('\n');
         }
     }
+    delete trace;
     return 0;
 }
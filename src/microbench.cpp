@@ -0,0 +1,405 @@
+/*
+ * time the inner kernels of the tree one by one
+ *   microbench [--scale n]
+ * each kernel runs on keys of 8, 24 and 64 bytes and on pages of several sizes (eles in use),
+ * a page of BreakBlock is always full, so it has one size
+ * cycles/op are from the time stamp counter (ns where there is none), allocs/op count operator new
+ * the work before each timed call (copying a page, setting up a father) is not counted
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+#include "utility/file_manager.hpp"
+#include "utility/vector.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+
+#endif
+
+using namespace std;
+
+static long allocation_num = 0;
+
+void *operator new(size_t size) {
+    ++allocation_num;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+//not inlined, or gcc sees free() of a pointer from new and warns
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    operator delete(p);
+}
+
+//operator new[] and delete[] go through the two above
+
+inline unsigned long long Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long) chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//a key of index_bytes bytes, compared like Key
+template<int index_bytes>
+struct BenchKey {
+    char index[index_bytes];
+    int value = 0;
+
+    BenchKey() {
+        memset(index, 0, sizeof(index));
+    }
+
+    BenchKey(const char *id, const int &value = 0) : value(value) {
+        strncpy(index, id, sizeof(index) - 1);
+        index[sizeof(index) - 1] = '\0';
+    }
+
+    bool operator<(const BenchKey &other) const {
+        int result = strcmp(index, other.index);
+        if (result) return result < 0;
+        return value < other.value;
+    }
+
+    bool operator==(const BenchKey &other) const {
+        return !strcmp(index, other.index) && value == other.value;
+    }
+};
+
+//what the kernels did, printed as one row
+struct Row {
+    unsigned long long cycles = 0;
+    long allocations = 0;
+    long ops = 0;
+};
+
+static volatile long sink;//results are written here so the kernels are not optimized away
+
+void Print(const char *kernel, int key_bytes, int page, const Row &row) {
+    printf("%-24s %4d %6d %12.1f %10.3f\n", kernel, key_bytes, page, (double) row.cycles / (double) row.ops,
+           (double) row.allocations / (double) row.ops);
+}
+
+template<class Key>
+class KernelBench {
+    using Tree = BPlusTree<Key, int>;
+    using KeyGroup = typename Tree::KeyGroup;
+    using ValueType = typename Tree::ValueType;
+    using Block = typename Tree::Block;
+    using Node = typename Tree::Node;
+    using NodeHandle = typename Tree::NodeHandle;
+    using BlockHandle = typename Tree::BlockHandle;
+    static constexpr int block_size = Tree::block_size;
+    static constexpr int node_size = Tree::node_size;
+    static constexpr int target_num = 4096;
+
+    int key_bytes;
+    long scale;
+    mt19937 random;
+    Key *keys;//sorted, 2*block_size of them
+    Tree *tree;//for the pools of the kernels that allocate pages
+
+public:
+    KernelBench(long scale, const string &file_name) : key_bytes((int) sizeof(Key().index)), scale(scale),
+                                                       random(7) {
+        keys = new Key[2 * block_size];
+        //the first half of an index is shared, as in indexes with a common prefix
+        char index[sizeof(Key().index)];
+        int length = (int) sizeof(index) - 1;
+        for (int i = 0; i < length; ++i) index[i] = (char) ('a' + random() % 26);
+        index[length] = '\0';
+        for (int i = 0; i < 2 * block_size; ++i) {
+            for (int j = length / 2; j < length; ++j) index[j] = (char) ('a' + random() % 26);
+            keys[i] = Key(index, (int) (random() % 4));
+        }
+        Sort(keys, 2 * block_size);
+        remove((file_name + "_tree").c_str());
+        remove((file_name + "_list").c_str());
+        tree = new Tree(file_name + "_tree", file_name + "_list");
+        this->file_name = file_name;
+    }
+
+    KernelBench(const KernelBench &) = delete;
+
+    KernelBench &operator=(const KernelBench &) = delete;
+
+    ~KernelBench() {
+        delete tree;
+        delete[] keys;
+        remove((file_name + "_tree").c_str());
+        remove((file_name + "_list").c_str());
+    }
+
+    void Run() {
+        Compare();
+        const int node_pages[3] = {16, 64, node_size};
+        for (int page : node_pages) SearchNode(page);
+        const int block_pages[3] = {64, 256, block_size - 1};
+        for (int page : block_pages) SearchBlock(page);
+        for (int page : block_pages) InsertInBlock(page);
+        BreakBlock();
+        AdjustRemoveInBlock("adjust_borrow_pre", block_size * 3 / 4, 1, 2);
+        AdjustRemoveInBlock("adjust_borrow_next", block_size * 3 / 4, 0, 2);
+        AdjustRemoveInBlock("adjust_merge_next", block_size / 2, 0, 2);
+        AdjustRemoveInBlock("adjust_merge_pre", block_size / 2, 1, 2);
+        PushBack();
+    }
+
+private:
+    string file_name;
+
+    static void Sort(Key *array, int n) {
+        for (int i = 1; i < n; ++i) {//insertion sort, done once
+            Key key = array[i];
+            int j = i - 1;
+            while (j >= 0 && key < array[j]) {
+                array[j + 1] = array[j];
+                --j;
+            }
+            array[j + 1] = key;
+        }
+    }
+
+    long Ops(long base) const {
+        return base * scale;
+    }
+
+    void Compare() {
+        long n = Ops(1 << 20);
+        Row row;
+        long result = 0;
+        long before = allocation_num;
+        unsigned long long start = Cycles();
+        for (long i = 0; i < n; ++i) {
+            result += keys[i & (2 * block_size - 1)] < keys[(i * 7 + 3) & (2 * block_size - 1)];
+        }
+        row.cycles = Cycles() - start;
+        row.allocations = allocation_num - before;
+        row.ops = n;
+        sink = result;
+        Print("Key::operator<", key_bytes, 0, row);
+    }
+
+    void SearchNode(int page) {
+        KeyGroup *array = new KeyGroup[page];
+        for (int i = 0; i < page; ++i) array[i] = KeyGroup(keys[(long) i * 2 * block_size / page]);
+        KeyGroup *targets = new KeyGroup[target_num];
+        for (int i = 0; i < target_num; ++i) targets[i] = KeyGroup(keys[random() % (2 * block_size)]);
+        long n = Ops(1 << 18);
+        Row row;
+        long result = 0;
+        long before = allocation_num;
+        unsigned long long start = Cycles();
+        for (long i = 0; i < n; ++i) {
+            result += tree->BinarySearch(array, 0, page - 1, targets[i & (target_num - 1)]);
+        }
+        row.cycles = Cycles() - start;
+        row.allocations = allocation_num - before;
+        row.ops = n;
+        sink = result;
+        Print("BinarySearch(KeyGroup)", key_bytes, page, row);
+        delete[] targets;
+        delete[] array;
+    }
+
+    void SearchBlock(int page) {
+        ValueType *array = new ValueType[page];
+        for (int i = 0; i < page; ++i) array[i] = ValueType(keys[(long) i * 2 * block_size / page], i);
+        ValueType *targets = new ValueType[target_num];
+        for (int i = 0; i < target_num; ++i) targets[i] = ValueType(keys[random() % (2 * block_size)]);
+        long n = Ops(1 << 18);
+        Row row;
+        long result = 0;
+        long before = allocation_num;
+        unsigned long long start = Cycles();
+        for (long i = 0; i < n; ++i) {
+            result += tree->BinarySearch(array, 0, page - 1, targets[i & (target_num - 1)]);
+        }
+        row.cycles = Cycles() - start;
+        row.allocations = allocation_num - before;
+        row.ops = n;
+        sink = result;
+        Print("BinarySearch(ValueType)", key_bytes, page, row);
+        delete[] targets;
+        delete[] array;
+    }
+
+    //a block of page eles taken from every other key, then one key between them is inserted
+    void InsertInBlock(int page) {
+        Block *full = new Block, *block = new Block;
+        full->size = page;
+        for (int i = 0; i < page; ++i) full->storage[i] = ValueType(keys[2 * i], i);
+        long n = Ops(1 << 12);
+        Row row;
+        for (long i = 0; i < n; ++i) {
+            int slot = (int) (random() % page);
+            std::copy(full->storage, full->storage + page, block->storage);
+            block->size = page;
+            const Key &key = keys[2 * slot + 1];
+            long before = allocation_num;
+            unsigned long long start = Cycles();
+            bool inserted = tree->InsertInBlock(*block, key, 0, false);
+            row.cycles += Cycles() - start;
+            row.allocations += allocation_num - before;
+            sink = inserted;
+        }
+        row.ops = n;
+        Print("InsertInBlock", key_bytes, page, row);
+        delete block;
+        delete full;
+    }
+
+    //a full block under a father of one son breaks, the new block is freed after
+    void BreakBlock() {
+        Node father_node;
+        long n = Ops(1 << 10);
+        Row row;
+        for (long i = 0; i < n; ++i) {
+            BlockHandle block = tree->block_pool.New();
+            for (int j = 0; j < block_size; ++j) block->storage[j] = ValueType(keys[j], j);
+            block->size = block_size;
+            block->next_block_address = block->prev_block_address = -1;
+            father_node.size = 1;
+            father_node.key[0] = KeyGroup(keys[block_size - 1], block.Address());
+            NodeHandle father(&father_node, 0);
+            long before = allocation_num;
+            unsigned long long start = Cycles();
+            tree->BreakBlock(block, father, 0);
+            row.cycles += Cycles() - start;
+            row.allocations += allocation_num - before;
+            tree->block_pool.Free(father_node.key[1].address);
+            block.Free();
+        }
+        row.ops = n;
+        Print("BreakBlock", key_bytes, block_size, row);
+    }
+
+    /*
+     * the block at index of a father with son_num blocks is left with block_size/2-1 eles
+     * its brothers have brother_size, so borrow or merge paths are taken
+     */
+    void AdjustRemoveInBlock(const char *kernel, int brother_size, int index, int son_num) {
+        Node father_node;
+        long n = Ops(1 << 10);
+        Row row;
+        for (long i = 0; i < n; ++i) {
+            BlockHandle sons[2];
+            int next_key = 0;
+            father_node.size = son_num;
+            for (int s = 0; s < son_num; ++s) {
+                sons[s] = tree->block_pool.New();
+                int size = s == index ? block_size / 2 - 1 : brother_size;
+                for (int j = 0; j < size; ++j) sons[s]->storage[j] = ValueType(keys[next_key + j], j);
+                next_key += size;
+                sons[s]->size = size;
+                sons[s]->next_block_address = sons[s]->prev_block_address = -1;
+                father_node.key[s] = KeyGroup(keys[next_key - 1], sons[s].Address());
+            }
+            for (int s = 0; s < son_num; ++s) {
+                if (s + 1 < son_num) sons[s]->next_block_address = sons[s + 1].Address();
+                if (s) sons[s]->prev_block_address = sons[s - 1].Address();
+            }
+            BlockHandle block = std::move(sons[index]);
+            for (int s = 0; s < son_num; ++s) sons[s].Release();//the kernel pins the brothers itself
+            NodeHandle father(&father_node, 0);
+            bool adjust_flag = true;
+            long before = allocation_num;
+            unsigned long long start = Cycles();
+            tree->AdjustRemoveInBlock(block, father, index, adjust_flag);
+            row.cycles += Cycles() - start;
+            row.allocations += allocation_num - before;
+            //free the blocks left, a merged one was freed by the kernel
+            block.Release();
+            for (int s = 0; s < father_node.size; ++s) tree->block_pool.Free(father_node.key[s].address);
+            sink = adjust_flag;
+        }
+        row.ops = n;
+        Print(kernel, key_bytes, block_size, row);
+    }
+
+    void PushBack() {
+        const int sizes[3] = {16, 1024, 1 << 16};
+        for (int size : sizes) {
+            long rounds = Ops((1 << 20) / size);
+            Row row;
+            long before = allocation_num;
+            unsigned long long start = Cycles();
+            for (long r = 0; r < rounds; ++r) {
+                sjtu::vector<ValueType> vec;
+                for (int i = 0; i < size; ++i) vec.push_back(ValueType(keys[i & (2 * block_size - 1)], i));
+                sink = (long) vec.size();
+            }
+            row.cycles = Cycles() - start;
+            row.allocations = allocation_num - before;
+            row.ops = rounds * size;
+            Print("vector::push_back", key_bytes, size, row);
+        }
+    }
+};
+
+//random reads of one int, the way main once read values from list_file
+void ReadEle(long scale, const string &file_name) {
+    remove(file_name.c_str());
+    const int file_ele_num = 1 << 16;
+    Row row;
+    {
+        FileManager<int> file(file_name);
+        int *values = new int[file_ele_num];
+        for (int i = 0; i < file_ele_num; ++i) values[i] = i;
+        file.WriteEle(0, 0, file_ele_num, values);
+        delete[] values;
+        mt19937 random(11);
+        long n = (1 << 16) * scale;
+        long result = 0;
+        long before = allocation_num;
+        unsigned long long start = Cycles();
+        for (long i = 0; i < n; ++i) {
+            int value;
+            file.ReadEle((long) (random() % file_ele_num) * (long) sizeof(int), value);
+            result += value;
+        }
+        row.cycles = Cycles() - start;
+        row.allocations = allocation_num - before;
+        row.ops = n;
+        sink = result;
+    }
+    remove(file_name.c_str());
+    Print("FileManager::ReadEle", (int) sizeof(int), file_ele_num, row);
+}
+
+int main(int argc, char **argv) {
+    long scale = 1;
+    if (argc == 3 && !strcmp(argv[1], "--scale")) scale = atol(argv[2]);
+    if (scale < 1) scale = 1;
+    printf("%-24s %4s %6s %12s %10s\n", "kernel", "key", "page", "cycles/op", "allocs/op");
+    {
+        KernelBench<BenchKey<8>> bench(scale, "microbench");
+        bench.Run();
+    }
+    {
+        KernelBench<BenchKey<24>> bench(scale, "microbench");
+        bench.Run();
+    }
+    {
+        KernelBench<Key> bench(scale, "microbench");
+        bench.Run();
+    }
+    ReadEle(scale, "microbench_file");
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * replay a trace recorded by code --record
+ *   replay trace [--paced] [--snapshot tree_file list_file]
+ * the operations are run on a fresh tree, or on a copy of the files given by --snapshot,
+ * as fast as possible or, with --paced, at the times they were recorded
+ * then throughput and latency percentiles of each kind of operation are printed
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+#include "utility/parallel_sort.hpp"
+#include "utility/trace.hpp"
+#include "utility/vector.hpp"
+
+using namespace std;
+
+const char *replay_tree = "replay_tree";
+const char *replay_list = "replay_list";
+
+bool CopyFile(const char *from, const char *to) {
+    ifstream in(from, ios::binary);
+    if (!in) return false;
+    ofstream out(to, ios::binary | ios::trunc);
+    out << in.rdbuf();
+    return out.good();
+}
+
+struct LongLess {
+    bool operator()(const long long &a, const long long &b) const {
+        return a < b;
+    }
+};
+
+void Report(const char *name, sjtu::vector<long long> &latency) {
+    long n = (long) latency.size();
+    if (!n) return;
+    long long *sorted = new long long[n];
+    long long total = 0;
+    for (long i = 0; i < n; ++i) {
+        sorted[i] = latency[i];
+        total += sorted[i];
+    }
+    sjtu::ParallelSort(sorted, n, LongLess(), 1);
+    const double percent[5] = {50, 90, 99, 99.9, 100};
+    printf("%-7s %10ld ops  mean %8.0f ns", name, n, (double) total / (double) n);
+    for (double p : percent) {
+        long rank = (long) (p / 100 * (double) (n - 1) + 0.5);
+        printf("  p%g %lld", p, sorted[rank]);
+    }
+    printf("\n");
+    delete[] sorted;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: replay trace [--paced] [--snapshot tree_file list_file]\n");
+        return 1;
+    }
+    bool paced = false;
+    const char *snapshot_tree = nullptr, *snapshot_list = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--paced")) paced = true;
+        else if (!strcmp(argv[i], "--snapshot") && i + 2 < argc) {
+            snapshot_tree = argv[++i];
+            snapshot_list = argv[++i];
+        }
+    }
+    TraceReader trace(argv[1]);
+    if (!trace.Good()) {
+        fprintf(stderr, "%s is not a trace\n", argv[1]);
+        return 1;
+    }
+    remove(replay_tree);
+    remove(replay_list);
+    if (snapshot_tree && (!CopyFile(snapshot_tree, replay_tree) || !CopyFile(snapshot_list, replay_list))) {
+        fprintf(stderr, "can't copy the snapshot\n");
+        return 1;
+    }
+    sjtu::vector<long long> latency[3];//of insert, delete, find
+    long long checksum = 0;//of the values found, equal runs give equal sums
+    chrono::steady_clock::time_point begin, end;
+    {
+        BPlusTree<Key, int> tree(replay_tree, replay_list);
+        TraceRecord record;
+        begin = chrono::steady_clock::now();
+        while (trace.Next(record)) {
+            if (paced) this_thread::sleep_until(begin + chrono::nanoseconds(record.time));
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            if (record.op == trace_insert) {
+                tree.Insert(Key(record.index, record.value), record.value);
+            } else if (record.op == trace_delete) {
+                tree.Delete(Key(record.index, record.value));
+            } else {
+                tree.Find(Key(record.index), cmp2(), [&checksum](const Key &, const int &value) {
+                    checksum = checksum * 31 + value;
+                    return true;
+                });
+            }
+            latency[record.op - trace_insert].push_back(
+                    chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+        end = chrono::steady_clock::now();
+    }
+    long total = (long) (latency[0].size() + latency[1].size() + latency[2].size());
+    double seconds = chrono::duration<double>(end - begin).count();
+    printf("%ld ops in %.3f s, %.0f ops/s, checksum %lld\n", total, seconds, seconds > 0 ? total / seconds : 0,
+           checksum);
+    Report("insert", latency[0]);
+    Report("delete", latency[1]);
+    Report("find", latency[2]);
+    return 0;
+}
@@ -1,16 +1,30 @@
 #ifndef TICKETSYSTEM_BPT_HPP
 #define TICKETSYSTEM_BPT_HPP
 
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <utility>
 #include "vector.hpp"
+#include "parallel_sort.hpp"
+#include "page_handle.hpp"
+#include "export_stream.hpp"
+#include "database.hpp"
+#include "exception.hpp"
 
 template<class Key, class Value>
 class BPlusTree {
+    //microbench.cpp times the private kernels one by one
+    template<class BenchKey> friend class KernelBench;
+
 private:
-    static constexpr int node_size = 200;
-    static constexpr int block_size = 1024;
+    //bytes of nodes one tree may cache by default
+    static constexpr long default_memory_budget = 64L << 20;
 
     //son: (,key]
     struct KeyGroup {
@@ -62,13 +76,31 @@ private:
         }
     };
 
+    /*
+     * a node keeps about the same bytes whatever Key is, so a small (e.g. integer) key gets a larger fan-out
+     * and fewer levels, 200 KeyGroups for the string Key
+     * node_size is even, a full node breaks into two halves of node_size/2
+     * a block keeps 1024 eles, blocks are read whole and not cached, so small keys read small blocks
+     */
+    static constexpr int node_bytes = 16000;
+    static constexpr int node_size = node_bytes / (int) sizeof(KeyGroup) / 2 * 2;
+    //Partition and the uneven break of sequential inserts need a few sons in a node
+    static_assert(node_size >= 4, "Key is too large for node_bytes, a node must hold at least 4 KeyGroups");
+    static constexpr int block_size = 1024;
+    //number of eles put into one block/node by bulk load
+    static constexpr int bulk_block_fill = block_size * 3 / 4;
+    static constexpr int bulk_node_fill = node_size * 3 / 4;
+    //a block under it is rebalanced by a delete in lazy mode, at least 1 so no empty block is left
+    static constexpr int lazy_block_fill = block_size / 8 > 0 ? block_size / 8 : 1;
+    //after this many inserts in a row past the last key, the right-most pages fill up before they break
+    static constexpr int sequential_run = 8;
+
     struct Node {
         int size = 0;
         bool son_is_block = true;//type of son
         /*
          * -1:normal
          * 0:is_root
-         * 1:son_of_root
          */
         int node_type = -1;
         KeyGroup key[node_size];
@@ -81,11 +113,12 @@ private:
         }
     };
 
-    //all the blocks are linked like a linkList
+    //all the blocks are linked like a linkList, both ways
     struct Block {
         int size = 0;
         ValueType storage[block_size];
         long next_block_address = -1;
+        long prev_block_address = -1;
 
         Block() = default;
 
@@ -97,6 +130,71 @@ private:
 
     };
 
+    using NodeHandle = PageHandle<Node>;
+    using BlockHandle = PageHandle<Block>;
+
+    //beginning of the tree file
+    struct Header {
+        long root = 0;//address of root_node
+        long free_node = -1;//first freed node
+        long free_block = -1;//first freed block in the list file
+        long free_node_num = 0, free_block_num = 0;//pages on the free lists
+        long ele_num = 0;
+        long node_num = 0, block_num = 0;//pages of the tree
+    };
+
+    struct Less {
+        bool operator()(const Key &a, const Key &b) const {
+            return a < b;
+        }
+    };
+
+    //only the first len chars of index are compared, keys starting with a prefix are equal to it
+    struct PrefixCompare {
+        size_t len;
+
+        bool operator()(const Key &a, const Key &b) const {
+            return strncmp(a.index, b.index, len) < 0;
+        }
+    };
+
+    //Analyze meets the blocks from left to right
+    struct ChainState {
+        long pre = -1;//address of the last block met
+        long pre_next = -1;//its next_block_address
+        long distance = 0;//sum of blocks between two neighbours in the file
+    };
+
+    //a range removal meets the blocks from left to right
+    struct RangeState {
+        BlockHandle last_kept;//its next_block_address is fixed when the next block kept is met
+        bool dropped = false;//blocks are dropped after last_kept, or from the start if it's empty
+        long first_kept = -1;//first block kept after dropped ones when no block is kept before
+        long next_address = -1;//next_block_address of the last block dropped
+        long removed = 0;//number of eles removed
+        //the tree may be underfull on the paths to these keys
+        bool has_left = false, has_right = false;
+        Key left_key, right_key;
+    };
+
+    //every key is equal, a range under it holds all the eles
+    struct AllEqual {
+        bool operator()(const Key &, const Key &) const {
+            return false;
+        }
+    };
+
+    enum LogOp {
+        log_insert, log_upsert, log_delete
+    };
+
+    //a change made during compaction to a key already copied
+    struct LogRecord {
+        LogOp op = log_insert;
+        Key key;
+        Value value;
+    };
+
     /*
      * address of root_node
      * read into memory when open the file
@@ -104,22 +202,202 @@ private:
      */
     long root = 0;
     /*
-     * read root_node and its son nodes into memory when construct
-     * write back when breakRoot(root changed), breakNode(add new son to root) and destruct
+     * read root_node into memory when construct
+     * write back when breakRoot(root changed) and destruct
      */
     Node root_node;//root of the tree
-    Node son_of_root[node_size];//son of root_node
-
-    Node current_node;
-    Block current_block;
+    int height = 1;//levels of nodes, root included
+    long ele_num = 0;//kept up to date by every change, recounted by Analyze
+    /*
+     * nodes of depth 1..resident_level stay cached in node_pool, root is depth 0
+     * decided by the memory budget of the tree, deeper levels are released after use
+     */
+    int resident_level = 0;
+    //a block with fewer eles borrows or merges after a delete, block_size/2 or lazy_block_fill
+    int min_block_fill = block_size / 2;
+    //inserts in a row whose key was greater than the key of every son of root
+    long append_run = 0;
 
     //associated with file when construct the tree
     std::fstream r_w_tree;
     std::fstream r_w_list;
+    //r_w_tree and r_w_list, or the file of the database for both
+    std::fstream *tree_file = &r_w_tree;
+    std::fstream *list_file = &r_w_list;
+    //bulk load workers open their own streams
+    std::string tree_file_name;
+    std::string list_file_name;
+    //a tree in a database keeps its header in the catalog
+    Database *database = nullptr;
+    int database_index = -1;
+
+    //frames of pages not resident in the tree, cached nodes are counted in the memory budget
+    PagePool<Node> node_pool;
+    PagePool<Block> block_pool;
+    long memory_budget = default_memory_budget;
+
+public:
+    //where a paged range query stopped, pass it back to get the next page
+    struct RangeCursor {
+        Key last;//the last key returned
+        bool started = false;//false: nothing returned yet
+        bool done = false;//no more ele in range
+    };
+
+    /*
+     * shape and space of the tree, bytes of the two files
+     * fill is size/capacity of a page, histogram[i] counts pages filled in [i/10,(i+1)/10)
+     */
+    struct TreeStats {
+        int height = 0;//levels of nodes and blocks, 0 if empty
+        long node_num = 0, block_num = 0, ele_num = 0;
+        double node_fill = 0, block_fill = 0;//average
+        long node_fill_histogram[10] = {}, block_fill_histogram[10] = {};
+        long free_node_num = 0, free_block_num = 0;//pages on the free lists, reused before the files grow
+        long free_bytes = 0;
+        long dead_bytes = 0;//pages neither in the tree nor on a free list
+        long tree_file_bytes = 0, list_file_bytes = 0;
+        //the blocks in key order as they lie in the list file
+        long sequential_link_num = 0;//the next block is right after it in the file
+        double average_link_distance = 0;//blocks between two linked ones in the file
+        long broken_link_num = 0;//next or prev address not the neighbour in key order
+    };
+
+private:
+    /*
+     * writes eles coming in key order into blocks one after another from base,
+     * so each block is linked to the blocks beside it in the file
+     * a full block is held back until the next one fills, so the last two can share their eles at Finish
+     */
+    struct LeafWriter {
+        std::fstream *file = nullptr;
+        long base = 0;
+        int fill = 0;//eles of a block
+        Block *block = nullptr;//the block being filled
+        Block *held = nullptr;//the full block before it, not written yet
+        long block_num = 0;//blocks written
+        long ele_num = 0;
+        sjtu::vector<KeyGroup> sons;//one for each block written
+
+        void Start(std::fstream &list, const long &address, int block_fill) {
+            file = &list;
+            base = address;
+            fill = block_fill;
+            block = new Block;
+            held = new Block;
+            block_num = ele_num = 0;
+            sons.clear();
+        }
+
+        void Put(const Key &key, const Value &value) {
+            if (block->size == fill) {
+                if (held->size) Write(*held, false);
+                std::swap(block, held);
+            }
+            block->storage[block->size++] = ValueType(key, value);
+            ++ele_num;
+        }
+
+        /*
+         * write the last blocks, the sons are left in sons
+         * a last block under half goes into the one before if that doesn't fill it, else the two are cut in halves
+         */
+        void Finish() {
+            if (held->size && block->size < block_size / 2) {
+                int total = held->size + block->size;
+                int keep = total < block_size ? total : total / 2;
+                if (keep >= held->size) {
+                    int move = keep - held->size;
+                    for (int i = 0; i < move; ++i) held->storage[held->size + i] = block->storage[i];
+                    for (int i = move; i < block->size; ++i) block->storage[i - move] = block->storage[i];
+                    held->size = keep;
+                    block->size -= move;
+                } else {
+                    int move = held->size - keep;
+                    for (int i = block->size - 1; i >= 0; --i) block->storage[i + move] = block->storage[i];
+                    for (int i = 0; i < move; ++i) block->storage[i] = held->storage[keep + i];
+                    held->size = keep;
+                    block->size += move;
+                }
+            }
+            if (held->size) Write(*held, !block->size);
+            if (block->size) Write(*block, true);
+            Stop();
+        }
+
+        void Stop() {
+            delete block;
+            delete held;
+            block = held = nullptr;
+        }
+
+        //last: no block follows
+        void Write(Block &page, bool last) {
+            long address = base + block_num * (long) sizeof(Block);
+            page.next_block_address = last ? -1 : address + (long) sizeof(Block);
+            page.prev_block_address = block_num ? address - (long) sizeof(Block) : -1;
+            file->seekp(address);
+            file->write(reinterpret_cast<char *> (&page), sizeof(Block));
+            sons.push_back(KeyGroup(page.storage[page.size - 1].key, address));
+            ++block_num;
+            page.size = 0;
+        }
+    };
+
+    /*
+     * how bulk load cuts n eles (or sons) into pages of fill
+     * a last page under half of capacity goes into the one before if that doesn't fill it,
+     * else the two are cut in halves, so no page is under half unless it is the only one
+     */
+    struct BulkCut {
+        long n = 0;
+        long fill = 0;
+        long page_num = 0;
+        long tail = 0;//eles of the last page
+
+        BulkCut(const long &n, int fill, int capacity) : n(n), fill(fill) {
+            page_num = (n + fill - 1) / fill;
+            tail = n - fill * (page_num - 1);
+            if (page_num > 1 && tail < capacity / 2) {
+                long total = fill + tail;//of the last two pages
+                if (total < capacity) {
+                    --page_num;
+                    tail = total;
+                } else tail = total / 2;
+            }
+        }
+
+        //first ele of page i, Begin(page_num) is n
+        long Begin(const long &i) const {
+            if (i >= page_num) return n;
+            if (i == page_num - 1) return n - tail;
+            return i * fill;
+        }
+    };
+
+    /*
+     * a compaction copies eles in key order into list_file_name + ".compact"
+     * the nodes are built into tree_file_name + ".compact" when all the eles are copied
+     */
+    struct CompactState {
+        bool running = false;
+        int node_fill = 0;//sons of a node
+        std::fstream list;
+        LeafWriter leaves;
+        RangeCursor cursor;//the last ele copied
+        sjtu::vector<LogRecord> log;
+    };
+
+    CompactState compact;
 
 public:
+
     //associate the tree with file
-    BPlusTree(const std::string &file_name, const std::string &list_name) {
+    BPlusTree(const std::string &file_name, const std::string &list_name,
+              MemoryBudget &budget = MemoryBudget::Process()) :
+            tree_file_name(file_name), list_file_name(list_name), node_pool(r_w_tree, budget),
+            block_pool(r_w_list, budget) {
+        RecoverCompact();
         r_w_tree.open(file_name);
 
         if (!r_w_tree.good()) {//doesn't exist
@@ -127,235 +405,1204 @@ public:
             r_w_tree.close();
             r_w_tree.open(file_name);
 
+            Header header;
             r_w_tree.seekp(0);//将指针定位到文件开头
-            r_w_tree.write(reinterpret_cast<char *> (&root), sizeof(root));
-            root_node.node_type = 0;
-            r_w_tree.seekp(0, std::ios::end);
-            root = r_w_tree.tellp();
-            r_w_tree.write(reinterpret_cast<char *> (&root_node), sizeof(root_node));//root_node may be empty
-
+            r_w_tree.write(reinterpret_cast<char *> (&header), sizeof(header));
             r_w_list.open(list_name, std::ios::out);
             r_w_list.close();
             r_w_list.open(list_name);
+            Create();
         } else {
 
             r_w_list.open(list_name);
-
-            //read root
-            r_w_tree.seekg(0);//将指针定位到文件开头
-            r_w_tree.read(reinterpret_cast<char *> (&root), sizeof(root));
-            //read root node into memory
-            ReadNode(root_node, root);
-            //if root have son node, read into memory
-            if (!root_node.son_is_block) {
-                int num = root_node.size;
-                for (int i = 0; i < num; ++i) {
-                    ReadNode(son_of_root[i], root_node.key[i].address);
-                }
-            }
+            Load();
         }
+        SetMemoryBudget(memory_budget);
+    }
+
+    /*
+     * the tree named name in db, created if there is none
+     * its pages are allocated in the file of db and cached within the memory of db
+     * a compaction is not supported
+     */
+    BPlusTree(Database &db, const std::string &name) :
+            tree_file_name(db.FileName()), list_file_name(db.FileName()), database(&db),
+            node_pool(db.Space(), db.Budget()), block_pool(db.Space(), db.Budget()) {
+        static_assert(sizeof(Header) <= Database::header_bytes, "header doesn't fit in the catalog");
+        tree_file = list_file = &db.File();
+        bool is_new;
+        database_index = db.OpenTree(name, is_new);
+        if (database_index == -1) throw sjtu::runtime_error();//the catalog is full
+        if (is_new) Create();
+        else Load();
+        SetMemoryBudget(db.Budget().Limit());
     }
 
     //if root_node changed,changed it in memory
     //write back when destruct
     ~BPlusTree() {
-        //write root
-        r_w_tree.seekp(0);//将指针定位到文件开头
-        r_w_tree.write(reinterpret_cast<char *>(&root), sizeof(root));
+        if (compact.running) AbortCompact();
+        Flush();
+    }
+
+    /*
+     * write root, free lists, counters and cached nodes, so the files alone hold the tree
+     * (and the catalog, for a tree in a database), e.g. around a WriteBatch
+     */
+    void Flush() {
+        Header header;
+        header.root = root;
+        header.free_node = node_pool.FreeHead();
+        header.free_block = block_pool.FreeHead();
+        header.free_node_num = node_pool.FreeNum();
+        header.free_block_num = block_pool.FreeNum();
+        header.ele_num = ele_num;
+        header.node_num = node_pool.PageNum();
+        header.block_num = block_pool.PageNum();
+        WriteHeader(header);
         //write root_node
         WriteNode(root_node, root);
-        if (!root_node.son_is_block) {
-            int num = root_node.size;
-            for (int i = 0; i < num; ++i) {
-                WriteNode(son_of_root[i], root_node.key[i].address);
-            }
+        //write cached nodes
+        node_pool.Flush();
+        block_pool.Flush();
+        tree_file->flush();
+        list_file->flush();
+        if (database) database->Flush();
+    }
+
+    //writes to the files of this tree are kept by journal from now on, nullptr: no more, see WriteBatch
+    void SetJournal(Journal *journal) {
+        if (database) {
+            database->SetJournal(journal);
+            return;
+        }
+        node_pool.Space().SetJournal(journal, tree_file_name);
+        block_pool.Space().SetJournal(journal, list_file_name);
+    }
+
+    /*
+     * bytes of nodes this tree may keep in memory, root_node not included
+     * the top levels that fit are kept resident, the process wide budget may still evict them
+     */
+    void SetMemoryBudget(const long &bytes) {
+        memory_budget = bytes;
+        node_pool.SetLimit(bytes);
+        UpdateResidentLevel();
+    }
+
+    /*
+     * in lazy mode a delete borrows or merges only when the block falls under lazy_block_fill,
+     * so it writes the block alone unless the block is almost empty,
+     * and eles deleted then inserted again don't make the same blocks merge and break over and over
+     * blocks left under half are merged by Tidy or rewritten by Compact
+     */
+    void SetLazyDelete(bool lazy) {
+        min_block_fill = lazy ? lazy_block_fill : block_size / 2;
+    }
+
+    /*
+     * borrow or merge for every block under half, e.g. after many lazy deletes
+     * only sizes of blocks are read to find them, return the number of blocks rebalanced
+     * afterwards no block is under half, unless the tree has only one
+     */
+    long Tidy() {
+        if (!root_node.size) return 0;
+        sjtu::vector<Key> targets;//upper bounds of the blocks under half
+        FindSparse(root_node, 0, targets);
+        int fill = min_block_fill;
+        min_block_fill = block_size / 2;
+        long rebalanced = 0;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (Rebalance(KeyGroup(targets[i]))) ++rebalanced;
         }
+        min_block_fill = fill;
+        ShrinkRoot();
+        return rebalanced;
     }
 
     //insert downwards
     //change key when getting down
     //break upwards
-    void Insert(const Key &key, const Value &value) {
-        if (!root_node.size) {//empty
-            Block new_block(key, value);
-            ++root_node.size;
-            r_w_list.seekp(0, std::ios::end);//the end of the file
-            root_node.key[0].key = key;
-            root_node.key[0].address = r_w_list.tellp();
-            WriteBlock(new_block, root_node.key[0].address);
-            return;
-        }
-        KeyGroup target(key);
-        InsertInNode(key, target, value, root_node);
-        if (root_node.size == node_size) {//root need to break
-            //write son_of_root
-            if (!root_node.son_is_block) {
-                for (int i = 0; i < node_size; ++i) {
-                    son_of_root[i].node_type = -1;
-                    WriteNode(son_of_root[i], root_node.key[i].address);
-                }
-            }
-            Node new_node;
-            root_node.node_type = new_node.node_type = 1;//son_of_root
-            root_node.size = new_node.size = node_size / 2;
-            for (int i = 0; i < new_node.size; ++i) {
-                new_node.key[i] = root_node.key[new_node.size + i];
-            }
-            new_node.son_is_block = root_node.son_is_block;
-            r_w_tree.seekp(0, std::ios::end);//the end of the file
-            Node new_root(KeyGroup(root_node.key[root_node.size - 1].key, root),
-                          KeyGroup(new_node.key[new_node.size - 1].key, r_w_tree.tellp()));
-            WriteNode(root_node, new_root.key[0].address);
-            WriteNode(new_node, new_root.key[1].address);
-            //update son_of_root
-            son_of_root[0] = root_node;
-            son_of_root[1] = new_node;
-            r_w_tree.seekp(0, std::ios::end);//the end of the file
-            root = r_w_tree.tellp();
-            root_node = new_root;
-            WriteNode(root_node, root);
-        }
+    //return false if key exists, nothing is changed
+    bool Insert(const Key &key, const Value &value) {
+        if (!Put(key, value, false)) return false;
+        LogCompact(log_insert, key, value);
+        return true;
+    }
+
+    /*
+     * change the value of key in place, return false if key doesn't exist
+     * one descent, only the block holding key is written, nothing is rebalanced
+     * the value before is copied to old if given
+     */
+    bool Update(const Key &key, const Value &value, Value *old = nullptr) {
+        if (!root_node.size) return false;//empty
+        BlockHandle block = LeafBlock(KeyGroup(key));
+        if (block.Empty()) return false;
+        int index_in_block = BinarySearch(block->storage, 0, block->size - 1, ValueType(key));
+        if (index_in_block == -1 || !(block->storage[index_in_block].key == key)) return false;
+        if (old) *old = block->storage[index_in_block].value;
+        block->storage[index_in_block].value = value;
+        block.MarkDirty();
+        LogCompact(log_upsert, key, value);
+        return true;
+    }
+
+    //the value of key in one descent, return false if key doesn't exist
+    bool Get(const Key &key, Value &value) {
+        if (!root_node.size) return false;//empty
+        BlockHandle block = LeafBlock(KeyGroup(key));
+        if (block.Empty()) return false;
+        int index_in_block = BinarySearch(block->storage, 0, block->size - 1, ValueType(key));
+        if (index_in_block == -1 || !(block->storage[index_in_block].key == key)) return false;
+        value = block->storage[index_in_block].value;
+        return true;
+    }
+
+    //insert key, or change its value if it exists, in one descent
+    //return true if key is new
+    bool Upsert(const Key &key, const Value &value) {
+        bool inserted = Put(key, value, true);
+        LogCompact(log_upsert, key, value);
+        return inserted;
     }
 
     //delete and adjust upwards
     bool Delete(const Key &key) {
-        long iter = 0;
+        if (!root_node.size) return false;//empty
         bool adjust_flag = true;
         KeyGroup target(key);
-        bool flag = RemoveInNode(key, target, iter, root_node, adjust_flag);
-        if (root_node.size == 1) {//root need to adjust
-            if (!root_node.son_is_block) {
-                //change root
-                root = root_node.key[0].address;
-                root_node = son_of_root[0];
-                root_node.node_type = 0;
-                //update son_of_root
-                if (!root_node.son_is_block)
-                    for (int i = 0; i < root_node.size; ++i) {
-                        ReadNode(son_of_root[i], root_node.key[i].address);
-                        son_of_root[i].node_type = 1;
-                    }
-            }
+        bool flag;
+        {
+            NodeHandle current(&root_node, root);
+            flag = RemoveInNode(key, target, current, 0, adjust_flag);
         }
+        if (flag) {
+            --ele_num;
+            LogCompact(log_delete, key, Value());
+        }
+        ShrinkRoot();
         return flag;
     }
 
+    /*
+     * remove every ele with lo <= key <= hi under cmp in one pass
+     * blocks inside the range are freed with only their sizes read, the two boundary ones are trimmed
+     * then the tree is rebalanced once along the two boundaries
+     */
+    template<class Compare>
+    void DeleteRange(const Key &lo, const Key &hi, const Compare &cmp) {
+        if (!root_node.size || cmp(hi, lo)) return;
+        LogCompactRange(lo, hi, cmp);
+        RangeState state;
+        {
+            NodeHandle current(&root_node, root);
+            RemoveRange(KeyGroup(lo), KeyGroup(hi), current, 0, cmp, state);
+        }
+        //link the blocks kept around the dropped ones
+        bool link_pre = false;//the block before the range should be linked to pre_next
+        long pre_next = -1;
+        if (state.first_kept != -1) {
+            link_pre = true;
+            pre_next = state.first_kept;
+        }
+        if (state.dropped) {
+            if (!state.last_kept.Empty()) {
+                state.last_kept->next_block_address = state.next_address;
+                state.last_kept.MarkDirty();
+                SetPrevBlock(state.next_address, state.last_kept.Address());
+            } else {
+                link_pre = true;
+                pre_next = state.next_address;
+            }
+        }
+        state.last_kept.Release();
+        ele_num -= state.removed;
+        if (link_pre) {
+            BlockHandle pre_block = PreBlock(KeyGroup(lo), cmp);
+            if (!pre_block.Empty()) {
+                pre_block->next_block_address = pre_next;
+                pre_block.MarkDirty();
+            }
+            SetPrevBlock(pre_next, pre_block.Empty() ? -1 : pre_block.Address());
+        }
+        if (state.has_left) Rebalance(KeyGroup(state.left_key));
+        if (state.has_right) Rebalance(KeyGroup(state.right_key));
+        ShrinkRoot();
+    }
+
+    void DeleteRange(const Key &lo, const Key &hi) {
+        DeleteRange(lo, hi, Less());
+    }
+
+    //remove every ele equal to key under cmp, e.g. all the values of an index with cmp2
+    template<class Compare>
+    void DeleteAll(const Key &key, const Compare &cmp) {
+        DeleteRange(key, key, cmp);
+    }
+
 
     template<class Compare>
     void Find(const Key &key, const Compare &cmp, sjtu::vector<Value> &vec) {
-        current_node = root_node;//start from root
-        long iter;
+        if (!root_node.size) return;//empty
         KeyGroup target(key);
-        FindNode(target, iter, cmp, vec);
+        FindNode(target, root_node, 0, cmp, vec);//start from root
     }
 
-    void Find(const Key &key) {
-        current_node = root_node;//start from root
-        long iter;
+    /*
+     * call visitor(key,value) for each ele equal to key under cmp, straight from the block
+     * visitor returns false to stop, the blocks after are not read
+     */
+    template<class Compare, class Visitor>
+    void Find(const Key &key, const Compare &cmp, Visitor visitor) {
+        if (!root_node.size) return;//empty
         KeyGroup target(key);
-        FindNode(target, iter);
+        FindNode(target, root_node, 0, cmp, visitor);//start from root
+    }
+
+    /*
+     * call visitor(key,value) for each ele whose index starts with prefix, in order
+     * nodes are searched with the prefix only, then the blocks are followed until the prefix stops matching
+     */
+    template<class Visitor>
+    void FindPrefix(const char *prefix, Visitor visitor) {
+        Key key;
+        strncpy(key.index, prefix, sizeof(key.index) - 1);
+        PrefixCompare cmp;
+        cmp.len = strlen(key.index);
+        Find(key, cmp, visitor);
+    }
+
+    /*
+     * call visitor(key,value) for each ele equal to key under cmp, from the last one backwards
+     * blocks are followed through prev_block_address, visitor returns false to stop
+     */
+    template<class Compare, class Visitor>
+    void FindReverse(const Key &key, const Compare &cmp, Visitor visitor) {
+        if (!root_node.size) return;//empty
+        ValueType target(key);
+        BlockHandle block = UpperBlock(KeyGroup(key), cmp);
+        int index_in_block = UpperBound(block->storage, 0, block->size - 1, target, cmp);
+        if (index_in_block == -1) index_in_block = block->size;
+        //eles after index_in_block are greater than key
+        while (true) {
+            for (--index_in_block; index_in_block >= 0; --index_in_block) {
+                const ValueType &ele = block->storage[index_in_block];
+                if (cmp(ele.key, target.key)) return;
+                if (!visitor(ele.key, ele.value)) return;
+            }
+            if (block->prev_block_address == -1) return;
+            block = PinBlock(block->prev_block_address);
+            index_in_block = block->size;
+        }
+    }
+
+    //values of the last limit eles equal to key under cmp, the last one first, limit<0: all of them
+    template<class Compare>
+    void FindReverse(const Key &key, const Compare &cmp, sjtu::vector<Value> &vec, long limit = -1) {
+        if (!limit) return;
+        long num = 0;
+        FindReverse(key, cmp, [&vec, &num, limit](const Key &, const Value &value) {
+            vec.push_back(value);
+            return limit < 0 || ++num < limit;
+        });
+    }
+
+    /*
+     * next page of at most limit eles with lo <= key <= hi under cmp, appended to result, limit<=0: no limit
+     * cursor keeps the last key returned, the next call seeks right after it instead of scanning from lo
+     * cursor.done is set when the range has no more ele
+     */
+    template<class Compare>
+    void Range(const Key &lo, const Key &hi, const Compare &cmp, long limit,
+               sjtu::vector<std::pair<Key, Value>> &result, RangeCursor &cursor) {
+        cursor.done = true;
+        if (!root_node.size || cmp(hi, lo)) return;
+        BlockHandle block;
+        int index_in_block;
+        if (cursor.started) {//first ele greater than last
+            block = UpperBlock(KeyGroup(cursor.last), Less());
+            index_in_block = UpperBound(block->storage, 0, block->size - 1, ValueType(cursor.last), Less());
+        } else {
+            block = LowerBlock(KeyGroup(lo), cmp);
+            index_in_block = BinarySearch(block->storage, 0, block->size - 1, ValueType(lo), cmp);
+        }
+        if (index_in_block == -1) index_in_block = block->size;
+        long num = 0;
+        while (true) {
+            for (; index_in_block < block->size; ++index_in_block) {
+                const ValueType &ele = block->storage[index_in_block];
+                if (cmp(hi, ele.key)) return;
+                if (limit > 0 && num == limit) {//one more is left
+                    cursor.done = false;
+                    return;
+                }
+                result.push_back(std::pair<Key, Value>(ele.key, ele.value));
+                cursor.last = ele.key;
+                cursor.started = true;
+                ++num;
+            }
+            if (block->next_block_address == -1) return;
+            block = PinBlock(block->next_block_address);
+            index_in_block = 0;
+        }
+    }
+
+    void Range(const Key &lo, const Key &hi, long limit, sjtu::vector<std::pair<Key, Value>> &result,
+               RangeCursor &cursor) {
+        Range(lo, hi, Less(), limit, result, cursor);
+    }
+
+    /*
+     * number of eles with lo <= key <= hi under cmp, no value is copied
+     * sons inside the range are counted by sizes of their blocks, only the boundary blocks are searched
+     */
+    template<class Compare>
+    long CountRange(const Key &lo, const Key &hi, const Compare &cmp) {
+        if (!root_node.size || cmp(hi, lo)) return 0;
+        return CountInNode(KeyGroup(lo), KeyGroup(hi), root_node, 0, cmp);
+    }
+
+    //number of eles equal to key under cmp, e.g. values of an index with cmp2
+    template<class Compare>
+    long Count(const Key &key, const Compare &cmp) {
+        return CountRange(key, key, cmp);
+    }
+
+    //smallest value of eles equal to key under cmp, return false if there is none
+    template<class Compare>
+    bool Min(const Key &key, const Compare &cmp, Value &result) {
+        bool found = false;
+        Find(key, cmp, [&](const Key &, const Value &value) {
+            if (!found || value < result) result = value;
+            found = true;
+            return true;
+        });
+        return found;
+    }
+
+    template<class Compare>
+    bool Max(const Key &key, const Compare &cmp, Value &result) {
+        bool found = false;
+        Find(key, cmp, [&](const Key &, const Value &value) {
+            if (!found || result < value) result = value;
+            found = true;
+            return true;
+        });
+        return found;
+    }
+
+    //total starts from total, pass a wider type (e.g. 0LL) to avoid overflow
+    template<class Compare, class Total>
+    Total Sum(const Key &key, const Compare &cmp, Total total) {
+        Find(key, cmp, [&total](const Key &, const Value &value) {
+            total += value;
+            return true;
+        });
+        return total;
+    }
+
+    /*
+     * cheap statistics from counters kept by every change, nothing is read
+     * histograms and links are left 0
+     * in a database, both files are the file of the database, free lists are shared by its trees
+     */
+    TreeStats Stats() {
+        TreeStats stats;
+        stats.height = root_node.size ? height + 1 : 0;
+        stats.tree_file_bytes = node_pool.FileEnd();
+        stats.list_file_bytes = block_pool.FileEnd();
+        stats.free_node_num = node_pool.FreeNum();
+        stats.free_block_num = block_pool.FreeNum();
+        stats.free_bytes = stats.free_node_num * (long) sizeof(Node) + stats.free_block_num * (long) sizeof(Block);
+        stats.node_num = node_pool.PageNum();
+        stats.block_num = block_pool.PageNum();
+        stats.ele_num = ele_num;
+        //every page but root is a son of one node
+        if (stats.node_num > 0) {
+            stats.node_fill = (double) (stats.node_num - 1 + stats.block_num) / ((double) stats.node_num * node_size);
+        }
+        if (stats.block_num > 0) stats.block_fill = (double) ele_num / ((double) stats.block_num * block_size);
+        return stats;
+    }
+
+    /*
+     * walk the whole tree, nodes are read, of blocks only size and the two links are read
+     * the links are checked against the order of blocks in the tree
+     * the ele counter kept by Stats is recounted
+     */
+    TreeStats Analyze() {
+        TreeStats stats = Stats();
+        long page_bytes = stats.node_num * (long) sizeof(Node) + stats.block_num * (long) sizeof(Block);
+        stats.node_num = stats.block_num = stats.ele_num = 0;
+        stats.node_fill = stats.block_fill = 0;
+        ChainState chain;
+        AnalyzeNode(root_node, 0, stats, chain);
+        if (chain.pre_next != -1) ++stats.broken_link_num;//the last block should end the list
+        ele_num = stats.ele_num;
+        stats.node_fill = (double) (stats.node_num - 1 + stats.block_num) / ((double) stats.node_num * node_size);
+        if (stats.block_num) stats.block_fill = (double) stats.ele_num / ((double) stats.block_num * block_size);
+        if (stats.block_num > 1) stats.average_link_distance = (double) chain.distance / (double) (stats.block_num - 1);
+        //pages counted as the tree's but not reached, and in its own files, bytes in no page
+        stats.dead_bytes = page_bytes - stats.node_num * (long) sizeof(Node) - stats.block_num * (long) sizeof(Block);
+        if (!database) {
+            stats.dead_bytes += stats.tree_file_bytes - (long) sizeof(Header) + stats.list_file_bytes -
+                                page_bytes - stats.free_bytes;
+        }
+        return stats;
+    }
+
+    /*
+     * build the tree from n (key,value) pairs at once, only works on an empty tree
+     * data is sorted in place unless is_sorted, ele with repeated key is kept only once
+     * each level is cut into ranges, workers pack and write pages of their range
+     * into a region reserved at the end of the file
+     * return false if the tree is not empty or being compacted
+     */
+    bool BulkLoad(std::pair<Key, Value> *data, long n, bool is_sorted = false, int thread_num = 0) {
+        if (root_node.size || compact.running) return false;
+        if (n <= 0) return true;
+        if (thread_num <= 0) thread_num = (int) std::thread::hardware_concurrency();
+        if (thread_num <= 0) thread_num = 1;
+        if (!is_sorted) {
+            sjtu::ParallelSort(data, n, [](const std::pair<Key, Value> &a, const std::pair<Key, Value> &b) {
+                return a.first < b.first;
+            }, thread_num);
+        }
+        long num = 1;//remove repeated key
+        for (long i = 1; i < n; ++i) {
+            if (!(data[num - 1].first == data[i].first)) {
+                if (num != i) data[num] = data[i];
+                ++num;
+            }
+        }
+        n = num;
+        ele_num = n;
+        //leaves
+        BulkCut cut(n, bulk_block_fill, block_size);
+        long son_num = cut.page_num;
+        KeyGroup *sons = new KeyGroup[son_num];
+        long base = block_pool.Allocate(son_num);
+        list_file->flush();
+        RunWorkers(son_num, thread_num, [&](long begin, long end) {
+            BuildBlocks(data, cut, begin, end, base, sons);
+        });
+        bool son_is_block = true;
+        height += BuildLevels(sons, son_num, son_is_block, bulk_node_fill, thread_num, tree_file_name,
+                              [this](long node_num) {
+                                  long address = node_pool.Allocate(node_num);
+                                  tree_file->flush();
+                                  return address;
+                              });
+        SetRoot(sons, son_num, son_is_block);
+        delete[] sons;
+        return true;
+    }
+
+    /*
+     * write every ele in key order to out as an export stream, following the blocks from the first one
+     * return the number of eles
+     */
+    long Export(std::ostream &out) {
+        ExportWriter<Key, Value> writer(out);
+        Find(Key(), AllEqual(), [&writer](const Key &key, const Value &value) {
+            writer.Put(key, value);
+            return true;
+        });
+        return (long) writer.Finish();
+    }
+
+    /*
+     * build the tree from an export stream, only works on an empty tree
+     * blocks are written one after another while the stream is read, then nodes are built as BulkLoad does
+     * return false if the tree is not empty, or the stream is broken or not sorted (the tree is left empty)
+     */
+    bool Import(std::istream &in, int thread_num = 0) {
+        if (root_node.size || compact.running) return false;
+        ExportReader<Key, Value> reader(in);
+        if (!reader.Good()) return false;
+        if (thread_num <= 0) thread_num = (int) std::thread::hardware_concurrency();
+        if (thread_num <= 0) thread_num = 1;
+        LeafWriter leaves;
+        leaves.Start(*list_file, block_pool.FileEnd(), bulk_block_fill);
+        Key key, pre_key;
+        Value value;
+        bool sorted = true;
+        while (reader.Next(key, value)) {
+            if (leaves.ele_num && !(pre_key < key)) {
+                sorted = false;
+                break;
+            }
+            leaves.Put(key, value);
+            pre_key = key;
+        }
+        if (!sorted || !reader.Good()) {//pages written after the end of the file are given out again
+            leaves.Stop();
+            return false;
+        }
+        leaves.Finish();
+        list_file->flush();
+        block_pool.Reserve(leaves.block_num);
+        ele_num = leaves.ele_num;
+        long son_num = 0;
+        KeyGroup *sons = TakeSons(leaves, son_num);
+        if (!son_num) {
+            delete[] sons;
+            return true;
+        }
+        bool son_is_block = true;
+        height += BuildLevels(sons, son_num, son_is_block, bulk_node_fill, thread_num, tree_file_name,
+                              [this](long node_num) {
+                                  long address = node_pool.Allocate(node_num);
+                                  tree_file->flush();
+                                  return address;
+                              });
+        SetRoot(sons, son_num, son_is_block);
+        delete[] sons;
+        return true;
+    }
+
+    /*
+     * start rewriting the tree into new files, blocks in key order and filled to fill (0,1]
+     * the copy goes on by CompactStep, the tree is used as usual between steps:
+     * changes to keys already copied are logged and replayed on the new tree
+     * return false if a compaction is running
+     */
+    bool StartCompact(double fill = 1) {
+        if (compact.running || database) return false;
+        int block_fill = (int) (block_size * fill);
+        if (block_fill >= block_size) block_fill = block_size - 1;
+        if (block_fill < 1) block_fill = 1;
+        compact.node_fill = (int) (node_size * fill);
+        if (compact.node_fill >= node_size) compact.node_fill = node_size - 1;
+        if (compact.node_fill < 2) compact.node_fill = 2;
+        compact.list.open(list_file_name + ".compact", std::ios::out | std::ios::trunc);
+        compact.leaves.Start(compact.list, 0, block_fill);
+        compact.cursor = RangeCursor();
+        compact.running = true;
+        return true;
+    }
+
+    /*
+     * copy about max_bytes of eles into the new files
+     * when all are copied, the new files replace the old ones and the log is replayed
+     * return true if the compaction is over
+     */
+    bool CompactStep(const long &max_bytes) {
+        if (!compact.running) return true;
+        long limit = max_bytes / (long) sizeof(ValueType);
+        if (limit < 1) limit = 1;
+        sjtu::vector<std::pair<Key, Value>> eles;
+        Range(Key(), Key(), AllEqual(), limit, eles, compact.cursor);
+        for (size_t i = 0; i < eles.size(); ++i) compact.leaves.Put(eles[i].first, eles[i].second);
+        if (!compact.cursor.done) return false;
+        FinishCompact();
+        return true;
+    }
+
+    bool Compacting() const {
+        return compact.running;
+    }
+
+    //compact in one call, copying at most bytes_per_second of eles per second, -1: no limit
+    void Compact(double fill = 1, long bytes_per_second = -1) {
+        if (!StartCompact(fill)) return;
+        long step = bytes_per_second > 0 ? Larger(bytes_per_second / 10, (long) sizeof(Block)) : 16L << 20;
+        auto begin = std::chrono::steady_clock::now();
+        double copied = 0;
+        while (!CompactStep(step)) {
+            copied += (double) step;
+            if (bytes_per_second > 0) {
+                std::this_thread::sleep_until(begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(copied / (double) bytes_per_second)));
+            }
+        }
     }
 
 
 private:
 
+    /*
+     * first index in [l,r] where before(array[index]) is false, -1 if none
+     * the window is halved without branching on before, so a cheap compare (integer keys) becomes a cmov
+     */
+    template<class Array, class Before>
+    int Partition(const Array array[], int l, int r, const Before &before) {
+        int n = r - l + 1;
+        if (n <= 0) return -1;
+        const Array *base = array + l;
+        while (n > 1) {
+            int half = n >> 1;
+            base = before(base[half - 1]) ? base + half : base;
+            n -= half;
+        }
+        int index = (int) (base - array) + (before(*base) ? 1 : 0);
+        return index > r ? -1 : index;
+    }
+
     template<class Array>
-    int BinarySearch(Array array[], int l, int r, const Array &target) {
-        int mid, ans = -1;
-        while (l <= r) {
-            mid = (l + r) >> 1;
-            if (array[mid] < target) {
-                l = mid + 1;
-            } else {
-                r = mid - 1;
-                ans = mid;
+    int BinarySearch(const Array array[], int l, int r, const Array &target) {
+        return Partition(array, l, r, [&target](const Array &ele) { return ele < target; });
+    }
+
+    template<class Array, class Compare>
+    int BinarySearch(const Array array[], int l, int r, const Array &target, const Compare &cmp) {
+        return Partition(array, l, r, [&target, &cmp](const Array &ele) { return cmp(ele.key, target.key); });
+    }
+
+    //first one greater than target under cmp, -1 if none
+    template<class Array, class Compare>
+    int UpperBound(const Array array[], int l, int r, const Array &target, const Compare &cmp) {
+        return Partition(array, l, r, [&target, &cmp](const Array &ele) { return !cmp(target.key, ele.key); });
+    }
+
+    //cut [0,total) into thread_num ranges and call work(begin,end) for each in its own thread
+    template<class Work>
+    void RunWorkers(long total, int thread_num, const Work &work) {
+        if (thread_num > total) thread_num = (int) total;
+        std::thread *workers = new std::thread[thread_num];
+        for (int i = 0; i < thread_num; ++i) {
+            long begin = total * i / thread_num, end = total * (i + 1) / thread_num;
+            workers[i] = std::thread([&work, begin, end]() { work(begin, end); });
+        }
+        for (int i = 0; i < thread_num; ++i) workers[i].join();
+        delete[] workers;
+    }
+
+    /*
+     * bulk load: write leaf [begin,end) of the leaves cut
+     * leaf i holds data[cut.Begin(i), cut.Begin(i+1)) and is placed at base+i*sizeof(Block)
+     * so the next_block_address of the last leaf in range is known without waiting for the next range
+     */
+    void BuildBlocks(const std::pair<Key, Value> *data, const BulkCut &cut, long begin, long end, long base,
+                     KeyGroup *sons) {
+        std::fstream r_w_file(list_file_name);
+        Block *block = new Block;
+        long block_num = cut.page_num;
+        for (long i = begin; i < end; ++i) {
+            long l = cut.Begin(i), r = cut.Begin(i + 1);
+            block->size = (int) (r - l);
+            for (long j = l; j < r; ++j) {
+                block->storage[j - l].key = data[j].first;
+                block->storage[j - l].value = data[j].second;
             }
+            block->next_block_address = i + 1 < block_num ? base + (i + 1) * (long) sizeof(Block) : -1;
+            block->prev_block_address = i ? base + (i - 1) * (long) sizeof(Block) : -1;
+            sons[i].key = data[r - 1].first;
+            sons[i].address = base + i * (long) sizeof(Block);
+            r_w_file.seekp(sons[i].address);
+            r_w_file.write(reinterpret_cast<char *> (block), sizeof(Block));
         }
-        return ans;
+        delete block;
     }
 
-    template<class Compare>
-    int BinarySearch(KeyGroup array[], int l, int r, const KeyGroup &target, const Compare &cmp) {
-        int mid, ans = -1;
-        while (l <= r) {
-            mid = (l + r) >> 1;
-            if (cmp(array[mid].key, target.key)) {
-                l = mid + 1;
-            } else {
-                r = mid - 1;
-                ans = mid;
+    /*
+     * build the levels above son_num sons, node_fill sons a node, until root can hold them
+     * allocate(node_num) reserves the pages of a level in file_name and returns the first address
+     * sons is replaced by the sons of root, return the number of levels built
+     */
+    template<class Allocate>
+    int BuildLevels(KeyGroup *&sons, long &son_num, bool &son_is_block, int node_fill, int thread_num,
+                    const std::string &file_name, const Allocate &allocate) {
+        int level = 0;
+        while (son_num >= node_size) {
+            BulkCut cut(son_num, node_fill, node_size);
+            long node_num = cut.page_num;
+            KeyGroup *fathers = new KeyGroup[node_num];
+            long base = allocate(node_num);
+            RunWorkers(node_num, thread_num, [&](long begin, long end) {
+                BuildNodes(file_name, sons, cut, begin, end, base, son_is_block, fathers);
+            });
+            delete[] sons;
+            sons = fathers;
+            son_num = node_num;
+            son_is_block = false;
+            ++level;
+        }
+        return level;
+    }
+
+    //bulk load: write node [begin,end) of the level above sons, same layout as BuildBlocks
+    void BuildNodes(const std::string &file_name, const KeyGroup *sons, const BulkCut &cut, long begin, long end,
+                    long base, bool son_is_block, KeyGroup *fathers) {
+        std::fstream r_w_file(file_name);
+        Node *node = new Node;
+        node->son_is_block = son_is_block;
+        for (long i = begin; i < end; ++i) {
+            long l = cut.Begin(i), r = cut.Begin(i + 1);
+            node->size = (int) (r - l);
+            for (long j = l; j < r; ++j) node->key[j - l] = sons[j];
+            fathers[i].key = sons[r - 1].key;
+            fathers[i].address = base + i * (long) sizeof(Node);
+            r_w_file.seekp(fathers[i].address);
+            r_w_file.write(reinterpret_cast<char *> (node), sizeof(Node));
+        }
+        delete node;
+    }
+
+    /*
+     * insert downwards, change key when getting down, break upwards
+     * overwrite: change the value if key exists
+     * return true if key is new
+     */
+    bool Put(const Key &key, const Value &value, bool overwrite) {
+        if (!root_node.size) {//empty
+            BlockHandle new_block = block_pool.New();
+            new_block->size = 1;
+            new_block->storage[0] = ValueType(key, value);
+            new_block->next_block_address = new_block->prev_block_address = -1;
+            ++root_node.size;
+            root_node.key[0].key = key;
+            root_node.key[0].address = new_block.Address();
+            ++ele_num;
+            return true;
+        }
+        KeyGroup target(key);
+        bool append = root_node.key[root_node.size - 1].key < key;
+        if (!append) append_run = 0;
+        else if (++append_run >= sequential_run) {//right-most leaf, no search on the way
+            NodeHandle current(&root_node, root);
+            if (AppendInNode(key, value, current, 0)) {
+                ++ele_num;
+                return true;
+            }
+        }
+        bool sequential = append_run >= sequential_run;
+        NodeHandle current(&root_node, root);
+        if (!InsertInNode(key, target, value, current, 0, overwrite, sequential)) return false;
+        ++ele_num;
+        if (root_node.size == node_size) {//root need to break
+            ++height;
+            //old root page keeps the first half (all but one son if sequential), the rest goes to a new page
+            NodeHandle pre_node = node_pool.New(root), new_node = node_pool.New();
+            pre_node->node_type = new_node->node_type = -1;
+            pre_node->son_is_block = new_node->son_is_block = root_node.son_is_block;
+            pre_node->size = sequential ? node_size - 1 : node_size / 2;
+            new_node->size = node_size - pre_node->size;
+            for (int i = 0; i < pre_node->size; ++i) pre_node->key[i] = root_node.key[i];
+            for (int i = 0; i < new_node->size; ++i) {
+                new_node->key[i] = root_node.key[pre_node->size + i];
+            }
+            root_node.size = 2;
+            root_node.son_is_block = false;
+            root_node.node_type = 0;
+            root_node.key[0] = KeyGroup(pre_node->key[pre_node->size - 1].key, pre_node.Address());
+            root_node.key[1] = KeyGroup(new_node->key[new_node->size - 1].key, new_node.Address());
+            root = node_pool.Allocate();
+            WriteNode(root_node, root);
+            UpdateResidentLevel();
+        }
+        return true;
+    }
+
+    //root_node holds the son_num sons built by a bulk load
+    void SetRoot(const KeyGroup *sons, long son_num, bool son_is_block) {
+        root_node.size = (int) son_num;
+        root_node.son_is_block = son_is_block;
+        root_node.node_type = 0;
+        for (int i = 0; i < son_num; ++i) root_node.key[i] = sons[i];
+        WriteNode(root_node, root);
+        UpdateResidentLevel();
+    }
+
+    //an empty root_node written to a new page
+    void Create() {
+        root_node.node_type = 0;
+        root = node_pool.Allocate();
+        WriteNode(root_node, root);//root_node may be empty
+    }
+
+    //at the beginning of the tree file, or in the catalog of the database
+    void ReadHeader(Header &header) {
+        if (database) {
+            database->ReadHeader(database_index, &header, sizeof(header));
+            return;
+        }
+        r_w_tree.seekg(0);//将指针定位到文件开头
+        r_w_tree.read(reinterpret_cast<char *> (&header), sizeof(header));
+    }
+
+    void WriteHeader(const Header &header) {
+        if (database) {
+            database->WriteHeader(database_index, &header, sizeof(header));
+            return;
+        }
+        node_pool.Space().BeforeWrite(0, (long) sizeof(header));
+        r_w_tree.seekp(0);//将指针定位到文件开头
+        r_w_tree.write(reinterpret_cast<const char *> (&header), sizeof(header));
+    }
+
+    //read header and root_node, count the levels
+    void Load() {
+        Header header;
+        ReadHeader(header);
+        root = header.root;
+        if (!database) {//free lists of a database are kept in its catalog
+            node_pool.SetFreeList(header.free_node, header.free_node_num);
+            block_pool.SetFreeList(header.free_block, header.free_block_num);
+        }
+        node_pool.SetPageNum(header.node_num);
+        block_pool.SetPageNum(header.block_num);
+        ele_num = header.ele_num;
+        //read root node into memory
+        ReadNode(root_node, root);
+        //count levels along the first son, nodes below root are read when needed
+        height = 1;
+        if (!root_node.son_is_block) {
+            NodeHandle current = node_pool.Pin(root_node.key[0].address);
+            ++height;
+            while (!current->son_is_block) {
+                current = node_pool.Pin(current->key[0].address);
+                ++height;
             }
         }
-        return ans;
     }
 
+    //log a change to key if it is already copied by the compaction
+    void LogCompact(LogOp op, const Key &key, const Value &value) {
+        if (!compact.running || !compact.cursor.started || compact.cursor.last < key) return;
+        LogRecord record;
+        record.op = op;
+        record.key = key;
+        record.value = value;
+        compact.log.push_back(record);
+    }
+
+    //a range removal is logged as removal of each ele copied in it
     template<class Compare>
-    int BinarySearch(ValueType array[], int l, int r, const ValueType &target, const Compare &cmp) {
-        int mid, ans = -1;
-        while (l <= r) {
-            mid = (l + r) >> 1;
-            if (cmp(array[mid].key, target.key)) {
-                l = mid + 1;
-            } else {
-                r = mid - 1;
-                ans = mid;
+    void LogCompactRange(const Key &lo, const Key &hi, const Compare &cmp) {
+        if (!compact.running || !compact.cursor.started) return;
+        RangeCursor cursor;
+        while (!cursor.done) {
+            sjtu::vector<std::pair<Key, Value>> eles;
+            Range(lo, hi, cmp, block_size, eles, cursor);
+            for (size_t i = 0; i < eles.size(); ++i) {
+                if (compact.cursor.last < eles[i].first) return;
+                LogCompact(log_delete, eles[i].first, eles[i].second);
             }
         }
-        return ans;
+    }
+
+    //sons of the blocks written by leaves, moved into an array
+    KeyGroup *TakeSons(LeafWriter &leaves, long &son_num) {
+        son_num = (long) leaves.sons.size();
+        KeyGroup *sons = new KeyGroup[son_num > 0 ? son_num : 1];
+        for (long i = 0; i < son_num; ++i) sons[i] = leaves.sons[i];
+        leaves.sons.clear();
+        return sons;
+    }
+
+    //build the nodes, put the new files in place of the old ones and replay the log
+    void FinishCompact() {
+        compact.leaves.Finish();
+        compact.list.close();
+        //nodes, the header is written last, a new tree file with root 0 is not complete
+        std::string new_tree = tree_file_name + ".compact";
+        Header header;
+        header.root = 0;
+        header.ele_num = compact.leaves.ele_num;
+        std::fstream file(new_tree, std::ios::out | std::ios::trunc);
+        file.write(reinterpret_cast<char *> (&header), sizeof(header));
+        file.close();
+        long son_num = 0, end = (long) sizeof(Header);
+        header.block_num = compact.leaves.block_num;
+        KeyGroup *sons = TakeSons(compact.leaves, son_num);
+        bool son_is_block = true;
+        BuildLevels(sons, son_num, son_is_block, compact.node_fill, 1, new_tree, [&end](long node_num) {
+            long address = end;
+            end += node_num * (long) sizeof(Node);
+            return address;
+        });
+        header.node_num = (end - (long) sizeof(Header)) / (long) sizeof(Node) + 1;
+        Node *new_root = new Node;
+        new_root->size = (int) son_num;
+        new_root->son_is_block = son_is_block;
+        new_root->node_type = 0;
+        for (long i = 0; i < son_num; ++i) new_root->key[i] = sons[i];
+        delete[] sons;
+        file.open(new_tree);
+        file.seekp(end);
+        file.write(reinterpret_cast<char *> (new_root), sizeof(Node));
+        delete new_root;
+        header.root = end;
+        file.seekp(0);
+        file.write(reinterpret_cast<char *> (&header), sizeof(header));
+        file.close();
+        //the old pages are dropped without being written
+        node_pool.Clear();
+        block_pool.Clear();
+        r_w_tree.close();
+        r_w_list.close();
+        SwapCompactFiles();
+        r_w_tree.open(tree_file_name);
+        r_w_list.open(list_file_name);
+        Load();
+        UpdateResidentLevel();
+        compact.running = false;
+        for (size_t i = 0; i < compact.log.size(); ++i) {
+            const LogRecord &record = compact.log[i];
+            if (record.op == log_insert) Insert(record.key, record.value);
+            else if (record.op == log_upsert) Upsert(record.key, record.value);
+            else Delete(record.key);
+        }
+        compact.log.clear();
+    }
+
+    void AbortCompact() {
+        compact.list.close();
+        compact.leaves.Stop();
+        compact.leaves.sons.clear();
+        compact.log.clear();
+        compact.running = false;
+        std::remove((list_file_name + ".compact").c_str());
+    }
+
+    //the new list file goes first, a new tree file left behind means the swap is not over
+    void SwapCompactFiles() {
+        std::rename((list_file_name + ".compact").c_str(), list_file_name.c_str());
+        std::rename((tree_file_name + ".compact").c_str(), tree_file_name.c_str());
+    }
+
+    //finish a swap stopped in the middle, or drop the files of a compaction not complete
+    void RecoverCompact() {
+        std::string new_tree = tree_file_name + ".compact";
+        Header header;
+        header.root = 0;
+        std::fstream file(new_tree, std::ios::in);
+        if (file.good()) file.read(reinterpret_cast<char *> (&header), sizeof(header));
+        bool complete = file.good() && header.root != 0;
+        file.close();
+        if (complete) SwapCompactFiles();
+        else {
+            std::remove(new_tree.c_str());
+            std::remove((list_file_name + ".compact").c_str());
+        }
     }
 
     template<class T>
-    T Max(const T &a, const T &b) {
+    T Larger(const T &a, const T &b) {
         return b < a ? a : b;
     }
 
     inline void ReadNode(Node &current, const long &iter) {
-        r_w_tree.seekg(iter);
-        r_w_tree.read(reinterpret_cast<char *> (&current), sizeof(Node));
+        node_pool.Read(current, iter);
+    }
+
+    inline void WriteNode(const Node &current, const long &iter) {
+        node_pool.Write(current, iter);
+    }
+
+    inline BlockHandle PinBlock(const long &iter) {
+        return block_pool.Pin(iter);
+    }
+
+    //prev_block_address of the block at address, written in place without reading the block
+    inline void SetPrevBlock(const long &address, const long &prev) {
+        if (address != -1) block_pool.WriteField(address, (long) offsetof(Block, prev_block_address), prev);
     }
 
-    inline void WriteNode(Node current, const long &iter) {
-        r_w_tree.seekp(iter);
-        r_w_tree.write(reinterpret_cast<char *> (&current), sizeof(Node));
+    //son of depth, cached in node_pool if its level is resident
+    inline NodeHandle SonNode(const Node &father, int index, int depth) {
+        return node_pool.Pin(father.key[index].address, depth <= resident_level);
     }
 
-    inline void ReadBlock(Block &current, const long &iter) {
-        r_w_list.seekg(iter);
-        r_w_list.read(reinterpret_cast<char *> (&current), sizeof(Block));
+    //block where eles not less than target under cmp begin, the last block if there is none
+    template<class Compare>
+    BlockHandle LowerBlock(const KeyGroup &target, const Compare &cmp) {
+        NodeHandle current(&root_node, root);
+        int depth = 0;
+        while (true) {
+            int index = BinarySearch(current->key, 0, current->size - 1, target, cmp);
+            if (index == -1) index = current->size - 1;
+            if (current->son_is_block) return PinBlock(current->key[index].address);
+            current = SonNode(*current, index, ++depth);
+        }
+    }
+
+    //block where eles greater than target under cmp begin, the last block if there is none
+    template<class Compare>
+    BlockHandle UpperBlock(const KeyGroup &target, const Compare &cmp) {
+        NodeHandle current(&root_node, root);
+        int depth = 0;
+        while (true) {
+            int index = UpperBound(current->key, 0, current->size - 1, target, cmp);
+            if (index == -1) index = current->size - 1;
+            if (current->son_is_block) return PinBlock(current->key[index].address);
+            current = SonNode(*current, index, ++depth);
+        }
+    }
+
+    //block whose range holds target, empty if target exceeds the last key
+    BlockHandle LeafBlock(const KeyGroup &target) {
+        int index = BinarySearch(root_node.key, 0, root_node.size - 1, target);
+        if (index == -1) return BlockHandle();
+        if (root_node.son_is_block) return PinBlock(root_node.key[index].address);
+        NodeHandle current = SonNode(root_node, index, 1);
+        int depth = 1;
+        while (true) {
+            index = BinarySearch(current->key, 0, current->size - 1, target);
+            if (index == -1) return BlockHandle();
+            if (current->son_is_block) return PinBlock(current->key[index].address);
+            current = SonNode(*current, index, ++depth);
+        }
     }
 
-    inline void WriteBlock(Block current, const long &iter) {
-        r_w_list.seekp(iter);
-        r_w_list.write(reinterpret_cast<char *> (&current), sizeof(Block));
+    /*
+     * decide how many levels under root are kept in memory
+     * level d has about root_node.size*(node_size*3/4)^(d-1) nodes,
+     * take the top levels as long as they fit in the budget
+     */
+    void UpdateResidentLevel() {
+        long budget = memory_budget;
+        long level_num = root_node.size;
+        resident_level = 0;
+        while (resident_level + 1 < height && level_num * PagePool<Node>::FrameSize() <= budget) {
+            budget -= level_num * PagePool<Node>::FrameSize();
+            ++resident_level;
+            level_num *= bulk_node_fill;
+        }
     }
 
     template<class Compare>
-    void GetEle(const ValueType &target, int index_in_block, const Compare &cmp, sjtu::vector<Value> &vec) {
-        while (index_in_block < current_block.size &&
-               !(cmp(current_block.storage[index_in_block].key, target.key) ||
-                 cmp(target.key, current_block.storage[index_in_block].key))) {
-            vec.push_back(current_block.storage[index_in_block].value);
-            ++index_in_block;
+    void GetEle(const ValueType &target, BlockHandle &block, int index_in_block, const Compare &cmp,
+                sjtu::vector<Value> &vec) {
+        while (true) {
+            //eles matched in one block are successive, find the end first and allocate once
+            int end = index_in_block;
+            while (end < block->size &&
+                   !(cmp(block->storage[end].key, target.key) ||
+                     cmp(target.key, block->storage[end].key))) {
+                ++end;
+            }
+            vec.reserve(vec.size() + end - index_in_block);
+            for (; index_in_block < end; ++index_in_block) {
+                vec.push_back(block->storage[index_in_block].value);
+            }
+            if (index_in_block < block->size || block->next_block_address == -1) return;
+            block = PinBlock(block->next_block_address);
+            index_in_block = 0;
         }
-        if (index_in_block == current_block.size && current_block.next_block_address > 0) {
-            long iter = current_block.next_block_address;
-            ReadBlock(current_block, iter);
-            GetEle(target, 0, cmp, vec);
+    }
+
+    template<class Compare, class Visitor>
+    void GetEle(const ValueType &target, BlockHandle &block, int index_in_block, const Compare &cmp,
+                Visitor &visitor) {
+        while (true) {
+            for (; index_in_block < block->size; ++index_in_block) {
+                const ValueType &ele = block->storage[index_in_block];
+                if (cmp(ele.key, target.key) || cmp(target.key, ele.key)) return;
+                if (!visitor(ele.key, ele.value)) return;
+            }
+            if (block->next_block_address == -1) return;
+            block = PinBlock(block->next_block_address);
+            index_in_block = 0;
         }
     }
 
+    //count eles in [lo,hi] under cmp below current, same cut of sons as RemoveRange
     template<class Compare>
-    void FindFirstEle(const Key &key, long &iter, const Compare &cmp, sjtu::vector<Value> &vec) {
-        ReadBlock(current_block, iter);
+    long CountInNode(const KeyGroup &lo, const KeyGroup &hi, const Node &current, int depth, const Compare &cmp) {
+        int l = BinarySearch(current.key, 0, current.size - 1, lo, cmp);
+        if (l == -1) return 0;//all less than lo
+        int r = UpperBound(current.key, l, current.size - 1, hi, cmp);
+        if (r == -1) r = current.size - 1;
+        long count = 0;
+        for (int i = l; i <= r; ++i) {
+            if (l < i && i < r) {//all eles of the son are in range
+                count += current.son_is_block ? BlockSize(current.key[i].address)
+                                              : SubtreeSize(current.key[i].address, depth + 1);
+            } else if (current.son_is_block) {
+                BlockHandle block = PinBlock(current.key[i].address);
+                int begin = BinarySearch(block->storage, 0, block->size - 1, ValueType(lo.key), cmp);
+                if (begin == -1) continue;
+                int end = UpperBound(block->storage, begin, block->size - 1, ValueType(hi.key), cmp);
+                count += (end == -1 ? block->size : end) - begin;
+            } else {
+                NodeHandle son = SonNode(current, i, depth + 1);
+                count += CountInNode(lo, hi, *son, depth + 1, cmp);
+            }
+        }
+        return count;
+    }
+
+    //number of eles under the node at address of depth
+    long SubtreeSize(const long &address, int depth) {
+        NodeHandle node = node_pool.Pin(address, depth <= resident_level);
+        long count = 0;
+        for (int i = 0; i < node->size; ++i) {
+            count += node->son_is_block ? BlockSize(node->key[i].address)
+                                        : SubtreeSize(node->key[i].address, depth + 1);
+        }
+        return count;
+    }
+
+    //current is of depth, count its pages into stats
+    void AnalyzeNode(const Node &current, int depth, TreeStats &stats, ChainState &chain) {
+        ++stats.node_num;
+        ++stats.node_fill_histogram[FillBucket(current.size, node_size)];
+        for (int i = 0; i < current.size; ++i) {
+            if (!current.son_is_block) {
+                NodeHandle son = SonNode(current, i, depth + 1);
+                AnalyzeNode(*son, depth + 1, stats, chain);
+                continue;
+            }
+            long address = current.key[i].address, next = -1, prev = -1;
+            int size = BlockSize(address);
+            block_pool.ReadField(address, (long) offsetof(Block, next_block_address), next);
+            block_pool.ReadField(address, (long) offsetof(Block, prev_block_address), prev);
+            ++stats.block_num;
+            stats.ele_num += size;
+            ++stats.block_fill_histogram[FillBucket(size, block_size)];
+            if (chain.pre != -1) {
+                if (chain.pre_next != address) ++stats.broken_link_num;
+                if (address == chain.pre + (long) sizeof(Block)) ++stats.sequential_link_num;
+                long gap = address - chain.pre;
+                chain.distance += (gap < 0 ? -gap : gap) / (long) sizeof(Block);
+            }
+            if (prev != chain.pre) ++stats.broken_link_num;
+            chain.pre = address;
+            chain.pre_next = next;
+        }
+    }
+
+    static int FillBucket(int size, int capacity) {
+        int bucket = size * 10 / capacity;
+        return bucket < 10 ? bucket : 9;
+    }
+
+    //upper bounds of the blocks under half in the subtree of current
+    void FindSparse(const Node &current, int depth, sjtu::vector<Key> &targets) {
+        for (int i = 0; i < current.size; ++i) {
+            if (current.son_is_block) {
+                if (BlockSize(current.key[i].address) * 2 < block_size) targets.push_back(current.key[i].key);
+            } else {
+                NodeHandle son = SonNode(current, i, depth + 1);
+                FindSparse(*son, depth + 1, targets);
+            }
+        }
+    }
+
+    //only size (the first field of Block) is read
+    int BlockSize(const long &address) {
+        int size = 0;
+        block_pool.ReadField(address, 0, size);
+        return size;
+    }
+
+    //result is a sjtu::vector<Value> or a visitor
+    template<class Compare, class Result>
+    void FindFirstEle(const Key &key, const long &iter, const Compare &cmp, Result &result) {
+        BlockHandle block = PinBlock(iter);
         ValueType target(key);
-        int index_in_block = BinarySearch(current_block.storage, 0, current_block.size - 1, target, cmp);
-        while (index_in_block == -1 && current_block.next_block_address != -1) {
-            ReadBlock(current_block, current_block.next_block_address);
-            index_in_block = BinarySearch(current_block.storage, 0, current_block.size - 1, target, cmp);
-        }
-        if (!(cmp(current_block.storage[index_in_block].key, target.key) ||
-              cmp(target.key, current_block.storage[index_in_block].key))) {
-            GetEle(target, index_in_block, cmp, vec);
+        int index_in_block = BinarySearch(block->storage, 0, block->size - 1, target, cmp);
+        while (index_in_block == -1 && block->next_block_address != -1) {
+            block = PinBlock(block->next_block_address);
+            index_in_block = BinarySearch(block->storage, 0, block->size - 1, target, cmp);
+        }
+        if (index_in_block == -1) return;
+        if (!(cmp(block->storage[index_in_block].key, target.key) ||
+              cmp(target.key, block->storage[index_in_block].key))) {
+            GetEle(target, block, index_in_block, cmp, result);
         } else return;
     }
 
@@ -365,220 +1612,208 @@ private:
       * not exist return false
       * exist return true
       */
-    template<class Compare>
-    void FindNode(const KeyGroup &target, long &iter, const Compare &cmp, sjtu::vector<Value> &vec) {
-        int index = BinarySearch(current_node.key, 0, current_node.size - 1, target, cmp);
-        if (index == -1) index = current_node.size - 1;
-        iter = current_node.key[index].address;
+    template<class Compare, class Result>
+    void FindNode(const KeyGroup &target, const Node &current, int depth, const Compare &cmp, Result &result) {
+        int index = BinarySearch(current.key, 0, current.size - 1, target, cmp);
+        if (index == -1) index = current.size - 1;
         //end of recursion
-        if (current_node.son_is_block) {
-            FindFirstEle(target.key, iter, cmp, vec);
+        if (current.son_is_block) {
+            FindFirstEle(target.key, current.key[index].address, cmp, result);
             return;
         }
-        if (!current_node.node_type) {//is_root
-            current_node = son_of_root[index];
-        } else ReadNode(current_node, iter);
-        FindNode(target, iter, cmp, vec);
+        NodeHandle son = SonNode(current, index, depth + 1);
+        FindNode(target, *son, depth + 1, cmp, result);
     }
 
-    void BreakNode(Node &current, Node &father, int index) {
-        Node new_node;
-        new_node.node_type = current.node_type;
-        current.size = new_node.size = node_size / 2;
-        for (int i = 0; i < new_node.size; ++i) {
-            new_node.key[i] = current.key[new_node.size + i];
+    //current is of depth
+    //current keeps its first keep sons, the others go to a new node
+    void BreakNode(NodeHandle &current, NodeHandle &father, int index, int depth, int keep = node_size / 2) {
+        NodeHandle new_node = node_pool.New(depth <= resident_level);
+        new_node->node_type = current->node_type;
+        new_node->size = node_size - keep;
+        current->size = keep;
+        for (int i = 0; i < new_node->size; ++i) {
+            new_node->key[i] = current->key[keep + i];
         }
-        new_node.son_is_block = current.son_is_block;
-        r_w_tree.seekp(0, std::ios::end);//the end of the file
-        for (int i = father.size; i > index + 1; --i) {
-            father.key[i] = father.key[i - 1];
+        new_node->son_is_block = current->son_is_block;
+        for (int i = father->size; i > index + 1; --i) {
+            father->key[i] = father->key[i - 1];
         }
-        father.key[index].key = current.key[current.size - 1].key;
-        father.key[index + 1].key = new_node.key[new_node.size - 1].key;
-        father.key[index + 1].address = r_w_tree.tellp();
-        if (current.node_type < 0) WriteNode(current, father.key[index].address);
-        WriteNode(new_node, father.key[index + 1].address);
-        if (new_node.node_type > 0) {
-            for (int i = father.size; i > index + 1; --i) {
-                son_of_root[i] = son_of_root[i - 1];
-            }
-            son_of_root[index + 1] = new_node;
-        }
-        ++father.size;
+        father->key[index].key = current->key[current->size - 1].key;
+        father->key[index + 1].key = new_node->key[new_node->size - 1].key;
+        father->key[index + 1].address = new_node.Address();
+        current.MarkDirty();
+        ++father->size;
     }
 
-    void BreakBlock(Node &father, int index) {
-        Block new_block;
-        new_block.size = block_size / 2;
-        current_block.size = block_size / 2;
-        for (int i = 0; i < new_block.size; ++i) {
-            new_block.storage[i] = current_block.storage[new_block.size + i];
+    //block keeps its first keep eles, the others go to a new block
+    void BreakBlock(BlockHandle &block, NodeHandle &father, int index, int keep = block_size / 2) {
+        BlockHandle new_block = block_pool.New();
+        new_block->size = block_size - keep;
+        block->size = keep;
+        for (int i = 0; i < new_block->size; ++i) {
+            new_block->storage[i] = block->storage[keep + i];
         }
-        new_block.next_block_address = current_block.next_block_address;
-        r_w_list.seekp(0, std::ios::end);//the end of the file
-        current_block.next_block_address = r_w_list.tellp();
-        WriteBlock(new_block, current_block.next_block_address);
-        WriteBlock(current_block, father.key[index].address);
-        for (int i = father.size; i > index + 1; --i) {
-            father.key[i] = father.key[i - 1];
+        new_block->next_block_address = block->next_block_address;
+        new_block->prev_block_address = block.Address();
+        SetPrevBlock(block->next_block_address, new_block.Address());
+        block->next_block_address = new_block.Address();
+        block.MarkDirty();
+        for (int i = father->size; i > index + 1; --i) {
+            father->key[i] = father->key[i - 1];
         }
-        father.key[index].key = current_block.storage[current_block.size - 1].key;
-        father.key[index + 1].key = new_block.storage[new_block.size - 1].key;
-        father.key[index + 1].address = current_block.next_block_address;
-        ++father.size;
+        father->key[index].key = block->storage[block->size - 1].key;
+        father->key[index + 1].key = new_block->storage[new_block->size - 1].key;
+        father->key[index + 1].address = new_block.Address();
+        ++father->size;
     }
 
 
-    void InsertInNode(const Key &key, const KeyGroup &target, const Value &value, Node &current, long iter = -1) {
-        bool write_current_flag = false;//if current is changed and is not root or son_of_root
-        int index = BinarySearch(current.key, 0, current.size - 1, target);
+    //return false if key already exists, its value is changed if overwrite
+    //a sequential insert goes past the last key, then a full right-most page keeps all but the new ele
+    bool InsertInNode(const Key &key, const KeyGroup &target, const Value &value, NodeHandle &current, int depth,
+                      bool overwrite, bool sequential) {
+        int index = BinarySearch(current->key, 0, current->size - 1, target);
         if (index == -1) {
-            current.key[current.size - 1].key = key;
-            write_current_flag = true;
-            index = current.size - 1;
+            current->key[current->size - 1].key = key;
+            current.MarkDirty();
+            index = current->size - 1;
         }
-        if (current.son_is_block) {
-            ReadBlock(current_block, current.key[index].address);
-            InsertInBlock(key, value);
-            if (current_block.size == block_size) {
-                BreakBlock(current, index);
-                if (current.node_type < 0) write_current_flag = true;
-            } else WriteBlock(current_block, current.key[index].address);
+        if (current->son_is_block) {
+            BlockHandle block = PinBlock(current->key[index].address);
+            bool inserted = InsertInBlock(*block, key, value, overwrite);
+            if (inserted || overwrite) block.MarkDirty();
+            if (!inserted) return false;//already exist
+            if (block->size == block_size) {
+                BreakBlock(block, current, index, sequential ? block_size - 1 : block_size / 2);
+                current.MarkDirty();
+            }
         } else {
-            if (!current.node_type) {//is root
-                InsertInNode(key, target, value, son_of_root[index]);
-                if (son_of_root[index].size == node_size) {
-                    BreakNode(son_of_root[index], current, index);
-                }
-            } else {
-                Node next_node;
-                ReadNode(next_node, current.key[index].address);
-                InsertInNode(key, target, value, next_node, current.key[index].address);
-                if (next_node.size == node_size) {
-                    BreakNode(next_node, current, index);
-                    if (current.node_type < 0) write_current_flag = true;
-                }
+            NodeHandle son = SonNode(*current, index, depth + 1);
+            if (!InsertInNode(key, target, value, son, depth + 1, overwrite, sequential)) return false;
+            if (son->size == node_size) {
+                BreakNode(son, current, index, depth + 1, sequential ? node_size - 1 : node_size / 2);
+                current.MarkDirty();
             }
         }
-        if (write_current_flag && current.node_type < 0)WriteNode(current, iter);
+        return true;
+    }
+
+    /*
+     * key is greater than every key, put it at the end of the right-most block and raise the keys on the way
+     * return false and change nothing if that block would be full, it is left to InsertInNode to break
+     */
+    bool AppendInNode(const Key &key, const Value &value, NodeHandle &current, int depth) {
+        int last = current->size - 1;
+        if (current->son_is_block) {
+            BlockHandle block = PinBlock(current->key[last].address);
+            if (block->size + 1 >= block_size) return false;
+            block->storage[block->size++] = ValueType(key, value);
+            block.MarkDirty();
+        } else {
+            NodeHandle son = SonNode(*current, last, depth + 1);
+            if (!AppendInNode(key, value, son, depth + 1)) return false;
+        }
+        current->key[last].key = key;
+        current.MarkDirty();
+        return true;
     }
 
-    void InsertInBlock(const Key &key, const Value &value) {
+    //return false if key already exists, its value is changed if overwrite
+    bool InsertInBlock(Block &block, const Key &key, const Value &value, bool overwrite) {
         ValueType target(key, value);
-        int index_in_block = BinarySearch(current_block.storage, 0, current_block.size - 1, target);
-        if (index_in_block == -1)index_in_block = current_block.size;
-        else if (current_block.storage[index_in_block].key == key) return;
-        for (int i = current_block.size; i > index_in_block; --i) {
-            current_block.storage[i] = current_block.storage[i - 1];
-        }
-        current_block.storage[index_in_block] = target;
-        ++current_block.size;
-    }
-
-    void AdjustRemoveInNode(Node &current, Node &father, int index, bool &adjust_flag) {
-        Node pre_node, next_node;
-        if (index) {
-            if (!father.node_type) {
-                pre_node = son_of_root[index - 1];
-            } else
-                ReadNode(pre_node, father.key[index - 1].address);
-        }
-        if (index < father.size - 1) {
-            if (!father.node_type) {
-                next_node = son_of_root[index + 1];
-            } else
-                ReadNode(next_node, father.key[index + 1].address);
-        }
-        if (pre_node.size > node_size / 2) {//borrow from the pre
+        int index_in_block = BinarySearch(block.storage, 0, block.size - 1, target);
+        if (index_in_block == -1)index_in_block = block.size;
+        else if (block.storage[index_in_block].key == key) {
+            if (overwrite) block.storage[index_in_block].value = value;
+            return false;
+        }
+        for (int i = block.size; i > index_in_block; --i) {
+            block.storage[i] = block.storage[i - 1];
+        }
+        block.storage[index_in_block] = target;
+        ++block.size;
+        return true;
+    }
+
+    //current is of depth
+    void AdjustRemoveInNode(NodeHandle &current, NodeHandle &father, int index, int depth, bool &adjust_flag) {
+        NodeHandle pre_node, next_node;
+        if (index) pre_node = SonNode(*father, index - 1, depth);
+        if (index < father->size - 1) next_node = SonNode(*father, index + 1, depth);
+        int pre_size = pre_node.Empty() ? 0 : pre_node->size;
+        int next_size = next_node.Empty() ? 0 : next_node->size;
+        //borrow only if both are at least half after it, else merge
+        if (pre_size && pre_size + current->size >= node_size) {//borrow from the pre
             //update array
-            int num = (current.size + pre_node.size) >> 1;
-            int move = pre_node.size - num;
-            for (int i = current.size - 1; i >= 0; --i) {
-                current.key[i + move] = current.key[i];
+            int num = (current->size + pre_node->size) >> 1;
+            int move = pre_node->size - num;
+            for (int i = current->size - 1; i >= 0; --i) {
+                current->key[i + move] = current->key[i];
             }
             for (int i = 0; i < move; ++i) {
-                current.key[i] = pre_node.key[num + i];
+                current->key[i] = pre_node->key[num + i];
             }
-            pre_node.size = num;
-            current.size += move;
+            pre_node->size = num;
+            current->size += move;
             //update key
-            father.key[index - 1].key = pre_node.key[num - 1].key;
-            if (pre_node.node_type == 1) {
-                son_of_root[index - 1] = pre_node;
-                son_of_root[index] = current;
-            }
-            if (current.node_type < 0) {
-                WriteNode(current, father.key[index].address);
-                WriteNode(pre_node, father.key[index - 1].address);
-            }
+            father->key[index - 1].key = pre_node->key[num - 1].key;
+            current.MarkDirty();
+            pre_node.MarkDirty();
             adjust_flag = false;
             return;
         }
-        if (next_node.size > node_size / 2) {//borrow from next
+        if (next_size && next_size + current->size >= node_size) {//borrow from next
             //update array
-            int num = (current.size + next_node.size) >> 1;
-            int move = next_node.size - num;
+            int num = (current->size + next_node->size) >> 1;
+            int move = next_node->size - num;
             for (int i = 0; i < move; ++i) {
-                current.key[current.size + i] = next_node.key[i];
+                current->key[current->size + i] = next_node->key[i];
             }
-            current.size += move;
-            next_node.size = num;
+            current->size += move;
+            next_node->size = num;
             for (int i = 0; i < num; ++i) {
-                next_node.key[i] = next_node.key[i + move];
-            }
-            father.key[index].key = current.key[current.size - 1].key;
-            if (next_node.node_type == 1) {
-                son_of_root[index + 1] = next_node;
-                son_of_root[index] = current;
-            }
-            if (current.node_type < 0) {
-                WriteNode(current, father.key[index].address);
-                WriteNode(next_node, father.key[index + 1].address);
+                next_node->key[i] = next_node->key[i + move];
             }
+            father->key[index].key = current->key[current->size - 1].key;
+            current.MarkDirty();
+            next_node.MarkDirty();
             adjust_flag = false;
             return;
         }
         //merge
         //try the next one
-        if (next_node.size) {//exist
-            int prime_size = current.size;
-            for (int i = 0; i < next_node.size; ++i) {
-                current.key[prime_size + i] = next_node.key[i];
-            }
-            current.size += next_node.size;
-            --father.size;
-            father.key[index].key = current.key[current.size - 1].key;
-            for (int i = index + 1; i < father.size; ++i) {
-                father.key[i] = father.key[i + 1];
-            }
-            if (!father.node_type) {//father is root
-                for (int i = index + 1; i < father.size; ++i) {
-                    son_of_root[i] = son_of_root[i + 1];
-                }
+        if (next_size) {//exist
+            int prime_size = current->size;
+            for (int i = 0; i < next_node->size; ++i) {
+                current->key[prime_size + i] = next_node->key[i];
+            }
+            current->size += next_node->size;
+            next_node.Free();
+            --father->size;
+            father->key[index].key = current->key[current->size - 1].key;
+            for (int i = index + 1; i < father->size; ++i) {
+                father->key[i] = father->key[i + 1];
             }
-            if (current.node_type < 0) WriteNode(current, father.key[index].address);
-            if (father.size * 2 >= node_size) adjust_flag = false;
+            current.MarkDirty();
+            if (father->size * 2 >= node_size) adjust_flag = false;
             return;
         }
-        if (pre_node.size) {//merge with pre
-            int prime_size = pre_node.size;
-            for (int i = 0; i < current.size; ++i) {
-                pre_node.key[prime_size + i] = current.key[i];
-            }
-            pre_node.size += current.size;
-            --father.size;
-            father.key[index - 1].key = pre_node.key[pre_node.size - 1].key;
-            for (int i = index; i < father.size; ++i) {
-                father.key[i] = father.key[i + 1];
-            }
-            if (!father.node_type) {//father is root
-                son_of_root[index - 1] = pre_node;
-                for (int i = index; i < father.size; ++i) {
-                    son_of_root[i] = son_of_root[i + 1];
-                }
+        if (pre_size) {//merge with pre
+            int prime_size = pre_node->size;
+            for (int i = 0; i < current->size; ++i) {
+                pre_node->key[prime_size + i] = current->key[i];
             }
-            if (pre_node.node_type < 0) WriteNode(pre_node, father.key[index - 1].address);
-            if (father.size * 2 >= node_size) adjust_flag = false;
+            pre_node->size += current->size;
+            --father->size;
+            father->key[index - 1].key = pre_node->key[pre_node->size - 1].key;
+            for (int i = index; i < father->size; ++i) {
+                father->key[i] = father->key[i + 1];
+            }
+            //current is merged away, drop it without writing back
+            current.Free();
+            pre_node.MarkDirty();
+            if (father->size * 2 >= node_size) adjust_flag = false;
             return;
         }
     }
@@ -588,86 +1823,88 @@ private:
      * borrow?
      * merge? always try to merge with the one after it
      */
-    void AdjustRemoveInBlock(Node &father, int index, bool &adjust_flag) {
-        Block pre_block, next_block;
-        if (index) {
-            ReadBlock(pre_block, father.key[index - 1].address);
-        }
-        if (index < father.size - 1) {
-            ReadBlock(next_block, father.key[index + 1].address);
-        }
-        if (pre_block.size > block_size / 2) {//borrow from the pre
+    void AdjustRemoveInBlock(BlockHandle &block, NodeHandle &father, int index, bool &adjust_flag) {
+        BlockHandle pre_block, next_block;
+        if (index) pre_block = PinBlock(father->key[index - 1].address);
+        if (index < father->size - 1) next_block = PinBlock(father->key[index + 1].address);
+        int pre_size = pre_block.Empty() ? 0 : pre_block->size;
+        int next_size = next_block.Empty() ? 0 : next_block->size;
+        //borrow only if both are at least half after it, else merge
+        if (pre_size && pre_size + block->size >= block_size) {//borrow from the pre
             //update array
-            int num = (current_block.size + pre_block.size) >> 1;
-            int move = pre_block.size - num;
-            for (int i = current_block.size - 1; i >= 0; --i) {
-                current_block.storage[i + move] = current_block.storage[i];
+            int num = (block->size + pre_block->size) >> 1;
+            int move = pre_block->size - num;
+            for (int i = block->size - 1; i >= 0; --i) {
+                block->storage[i + move] = block->storage[i];
             }
             for (int i = 0; i < move; ++i) {
-                current_block.storage[i] = pre_block.storage[num + i];
+                block->storage[i] = pre_block->storage[num + i];
             }
-            pre_block.size = num;
-            current_block.size += move;
+            pre_block->size = num;
+            block->size += move;
             //update key
-            father.key[index - 1].key = pre_block.storage[num - 1].key;
-            WriteBlock(current_block, father.key[index].address);
-            WriteBlock(pre_block, father.key[index - 1].address);
+            father->key[index - 1].key = pre_block->storage[num - 1].key;
+            block.MarkDirty();
+            pre_block.MarkDirty();
             adjust_flag = false;
             return;
         }
-        if (next_block.size > block_size / 2) {//borrow from next
+        if (next_size && next_size + block->size >= block_size) {//borrow from next
             //update array
-            int num = (current_block.size + next_block.size) >> 1;
-            int move = next_block.size - num;
+            int num = (block->size + next_block->size) >> 1;
+            int move = next_block->size - num;
             for (int i = 0; i < move; ++i) {
-                current_block.storage[current_block.size + i] = next_block.storage[i];
+                block->storage[block->size + i] = next_block->storage[i];
             }
-            current_block.size += move;
-            next_block.size = num;
+            block->size += move;
+            next_block->size = num;
             for (int i = 0; i < num; ++i) {
-                next_block.storage[i] = next_block.storage[i + move];
+                next_block->storage[i] = next_block->storage[i + move];
             }
-            father.key[index].key = current_block.storage[current_block.size - 1].key;
-            WriteBlock(current_block, father.key[index].address);
-            WriteBlock(next_block, father.key[index + 1].address);
+            father->key[index].key = block->storage[block->size - 1].key;
+            block.MarkDirty();
+            next_block.MarkDirty();
             adjust_flag = false;
             return;
         }
         //merge
         //try the next one
-        if (next_block.size) {//exist
-            int prime_size = current_block.size;
-            for (int i = 0; i < next_block.size; ++i) {
-                current_block.storage[prime_size + i] = next_block.storage[i];
-            }
-            current_block.size += next_block.size;
-            current_block.next_block_address = next_block.next_block_address;
-            --father.size;
-            father.key[index].key = current_block.storage[current_block.size - 1].key;
-            for (int i = index + 1; i < father.size; ++i) {
-                father.key[i] = father.key[i + 1];
-            }
-            WriteBlock(current_block, father.key[index].address);
-            if (father.size * 2 >= node_size) adjust_flag = false;
+        if (next_size) {//exist
+            int prime_size = block->size;
+            for (int i = 0; i < next_block->size; ++i) {
+                block->storage[prime_size + i] = next_block->storage[i];
+            }
+            block->size += next_block->size;
+            block->next_block_address = next_block->next_block_address;
+            SetPrevBlock(block->next_block_address, block.Address());
+            next_block.Free();
+            --father->size;
+            father->key[index].key = block->storage[block->size - 1].key;
+            for (int i = index + 1; i < father->size; ++i) {
+                father->key[i] = father->key[i + 1];
+            }
+            block.MarkDirty();
+            if (father->size * 2 >= node_size) adjust_flag = false;
             return;
         }
-        if (pre_block.size) {//merge with pre
-            int prime_size = pre_block.size;
-            for (int i = 0; i < current_block.size; ++i) {
-                pre_block.storage[prime_size + i] = current_block.storage[i];
+        if (pre_size) {//merge with pre
+            int prime_size = pre_block->size;
+            for (int i = 0; i < block->size; ++i) {
+                pre_block->storage[prime_size + i] = block->storage[i];
             }
-            pre_block.size += current_block.size;
-            pre_block.next_block_address = current_block.next_block_address;
-            --father.size;
-            father.key[index - 1].key = pre_block.storage[pre_block.size - 1].key;
-            for (int i = index; i < father.size; ++i) {
-                father.key[i] = father.key[i + 1];
+            pre_block->size += block->size;
+            pre_block->next_block_address = block->next_block_address;
+            SetPrevBlock(block->next_block_address, pre_block.Address());
+            --father->size;
+            father->key[index - 1].key = pre_block->storage[pre_block->size - 1].key;
+            for (int i = index; i < father->size; ++i) {
+                father->key[i] = father->key[i + 1];
             }
-            WriteBlock(pre_block, father.key[index - 1].address);
-            if (father.size * 2 >= node_size) adjust_flag = false;
+            block.Free();
+            pre_block.MarkDirty();
+            if (father->size * 2 >= node_size) adjust_flag = false;
             return;
         }
-        WriteBlock(current_block, father.key[index].address);
     }
 
     /*
@@ -679,56 +1916,248 @@ private:
      * adjust_flag==true:adjust upwards
      *              false:"stop"(node remain unchanged)
      */
-    bool RemoveInNode(const Key &key, const KeyGroup &target, long &iter, Node &current, bool &adjust_flag) {
-        if (current.key[current.size - 1].GetKey() < key) {//exceed
+    bool RemoveInNode(const Key &key, const KeyGroup &target, NodeHandle &current, int depth, bool &adjust_flag) {
+        if (current->key[current->size - 1].GetKey() < key) {//exceed
             return false;
         }
         //the index of the section
-        int index = BinarySearch(current.key, 0, current.size - 1, target);
-        iter = current.key[index].address;
+        int index = BinarySearch(current->key, 0, current->size - 1, target);
         //end of recursion
-        if (current.son_is_block) {
-            if (!RemoveInBlock(key, iter, adjust_flag)) return false;//doesn't exist
-            if (adjust_flag) AdjustRemoveInBlock(current, index, adjust_flag);
+        if (current->son_is_block) {
+            BlockHandle block = PinBlock(current->key[index].address);
+            if (!RemoveInBlock(block, key, adjust_flag)) return false;//doesn't exist
+            if (!adjust_flag) return true;//only the block is written
+            AdjustRemoveInBlock(block, current, index, adjust_flag);
         } else {
             //next layer
-            if (!current.node_type) {
-                if (!RemoveInNode(key, target, iter, son_of_root[index], adjust_flag))return false;
-                if (adjust_flag) AdjustRemoveInNode(son_of_root[index], current, index, adjust_flag);
-                if (!adjust_flag) current.key[index].key = son_of_root[index].key[son_of_root[index].size - 1].key;
-            } else {
-                Node next;
-                ReadNode(next, iter);
-                if (!RemoveInNode(key, target, iter, next, adjust_flag))return false;
-                if (adjust_flag) AdjustRemoveInNode(next, current, index, adjust_flag);
-                else {
-                    if (next.node_type < 0) WriteNode(next, current.key[index].address);//write back
-                }
-                if (!adjust_flag) current.key[index].key = next.key[next.size - 1].key;
+            NodeHandle son = SonNode(*current, index, depth + 1);
+            if (!RemoveInNode(key, target, son, depth + 1, adjust_flag))return false;
+            bool adjusted = adjust_flag;
+            if (adjust_flag) AdjustRemoveInNode(son, current, index, depth + 1, adjust_flag);
+            if (!adjust_flag && !son.Empty()) {
+                if (!adjusted && current->key[index].key == son->key[son->size - 1].key) return true;//unchanged
+                current->key[index].key = son->key[son->size - 1].key;
             }
         }
+        current.MarkDirty();
         return true;
     }
 
-    bool RemoveInBlock(const Key &key, long &iter, bool &adjust_flag) {
-        ReadBlock(current_block, iter);
+    bool RemoveInBlock(BlockHandle &block, const Key &key, bool &adjust_flag) {
         ValueType target(key);
-        int index_in_block = BinarySearch(current_block.storage, 0, current_block.size - 1, target);
-        if (current_block.storage[index_in_block].key == key) {//the ele to be removed
-            --current_block.size;
-            for (int i = index_in_block; i < current_block.size; ++i) {
-                current_block.storage[i] = current_block.storage[i + 1];
-            }
-            if (current_block.size * 2 >= block_size) {
-                adjust_flag = false;
-                WriteBlock(current_block, iter);//if block need to adjust don't write
+        int index_in_block = BinarySearch(block->storage, 0, block->size - 1, target);
+        if (index_in_block != -1 && block->storage[index_in_block].key == key) {//the ele to be removed
+            --block->size;
+            for (int i = index_in_block; i < block->size; ++i) {
+                block->storage[i] = block->storage[i + 1];
             }
+            block.MarkDirty();
+            if (block->size >= min_block_fill) adjust_flag = false;
         } else {
             adjust_flag = false;
             return false;
         }
         return true;
     }
+
+    //root with only one son node is replaced by the son, an empty root is reset to hold blocks
+    void ShrinkRoot() {
+        bool changed = false;
+        while (root_node.size == 1 && !root_node.son_is_block) {
+            //change root, the page of the only son is the new root
+            long pre_root = root;
+            root = root_node.key[0].address;
+            NodeHandle son = node_pool.Pin(root);
+            root_node = *son;
+            son.Discard();
+            node_pool.Free(pre_root);
+            root_node.node_type = 0;
+            --height;
+            changed = true;
+        }
+        if (!root_node.size && !root_node.son_is_block) {
+            root_node.son_is_block = true;
+            height = 1;
+            changed = true;
+        }
+        if (changed) UpdateResidentLevel();
+    }
+
+    /*
+     * remove eles in [lo,hi] under cmp from the sons of current
+     * sons inside the range are freed, sons on the boundary are trimmed, empty ones are freed too
+     * the sons kept are moved together, keys of the trimmed ones are updated
+     */
+    template<class Compare>
+    void RemoveRange(const KeyGroup &lo, const KeyGroup &hi, NodeHandle &current, int depth, const Compare &cmp,
+                     RangeState &state) {
+        int l = BinarySearch(current->key, 0, current->size - 1, lo, cmp);
+        if (l == -1) return;//all less than lo
+        int r = UpperBound(current->key, l, current->size - 1, hi, cmp);
+        if (r == -1) r = current->size - 1;
+        int kept = l;//sons kept are moved to [l,kept)
+        for (int i = l; i <= r; ++i) {
+            long address = current->key[i].address;
+            bool inside = l < i && i < r;//all eles of the son are in range
+            if (current->son_is_block) {
+                if (inside) {
+                    state.removed += BlockSize(address);
+                    block_pool.Free(address);
+                    state.dropped = true;
+                    continue;
+                }
+                BlockHandle block = PinBlock(address);
+                int begin = BinarySearch(block->storage, 0, block->size - 1, ValueType(lo.key), cmp);
+                if (begin == -1) begin = block->size;
+                int end = UpperBound(block->storage, begin, block->size - 1, ValueType(hi.key), cmp);
+                if (end == -1) end = block->size;
+                if (begin > 0 && !state.has_left) {
+                    state.has_left = true;
+                    state.left_key = block->storage[begin - 1].key;
+                }
+                if (end < block->size && !state.has_right) {
+                    state.has_right = true;
+                    state.right_key = block->storage[end].key;
+                }
+                if (begin < end) {
+                    for (int j = end; j < block->size; ++j) {
+                        block->storage[begin + j - end] = block->storage[j];
+                    }
+                    block->size -= end - begin;
+                    state.removed += end - begin;
+                    block.MarkDirty();
+                }
+                if (!block->size) {
+                    state.next_address = block->next_block_address;
+                    state.dropped = true;
+                    block.Free();
+                    continue;
+                }
+                current->key[kept++] = KeyGroup(block->storage[block->size - 1].key, address);
+                KeepBlock(block, state);
+            } else {
+                if (inside) {
+                    state.removed += FreeSubtree(address);
+                    state.dropped = true;
+                    continue;
+                }
+                NodeHandle son = SonNode(*current, i, depth + 1);
+                RemoveRange(lo, hi, son, depth + 1, cmp, state);
+                if (!son->size) {
+                    son.Free();
+                    continue;
+                }
+                current->key[kept++] = KeyGroup(son->key[son->size - 1].key, address);
+            }
+        }
+        //the deepest node with sons left untouched decides where to rebalance
+        if (l > 0 && !state.has_left) {
+            state.has_left = true;
+            state.left_key = current->key[l - 1].key;
+        }
+        if (r + 1 < current->size && !state.has_right) {
+            state.has_right = true;
+            state.right_key = current->key[r + 1].key;
+        }
+        for (int i = r + 1; i < current->size; ++i) {
+            current->key[kept + i - r - 1] = current->key[i];
+        }
+        current->size = kept + current->size - r - 1;
+        current.MarkDirty();
+    }
+
+    //link the last block kept to block if blocks between them are dropped
+    void KeepBlock(BlockHandle &block, RangeState &state) {
+        if (state.dropped) {
+            if (!state.last_kept.Empty()) {
+                state.last_kept->next_block_address = block.Address();
+                state.last_kept.MarkDirty();
+                block->prev_block_address = state.last_kept.Address();
+                block.MarkDirty();
+            } else state.first_kept = block.Address();
+            state.dropped = false;
+        }
+        state.last_kept = std::move(block);
+    }
+
+    //free every page under the node at address, return the number of eles, only sizes of blocks are read
+    long FreeSubtree(const long &address) {
+        NodeHandle node = node_pool.Pin(address);
+        long count = 0;
+        for (int i = 0; i < node->size; ++i) {
+            if (node->son_is_block) {
+                count += BlockSize(node->key[i].address);
+                block_pool.Free(node->key[i].address);
+            } else count += FreeSubtree(node->key[i].address);
+        }
+        node.Free();
+        return count;
+    }
+
+    //the last block whose eles are all less than target under cmp, empty if there is none
+    template<class Compare>
+    BlockHandle PreBlock(const KeyGroup &target, const Compare &cmp) {
+        if (!root_node.size) return BlockHandle();
+        NodeHandle current(&root_node, root);
+        int depth = 0, pre_depth = 0;
+        long pre_address = -1;
+        bool pre_is_block = true;
+        //the deepest son before the path to target
+        while (true) {
+            int index = BinarySearch(current->key, 0, current->size - 1, target, cmp);
+            if (index != 0) {
+                pre_address = current->key[index == -1 ? current->size - 1 : index - 1].address;
+                pre_is_block = current->son_is_block;
+                pre_depth = depth + 1;
+            }
+            if (index == -1 || current->son_is_block) break;
+            current = SonNode(*current, index, ++depth);
+        }
+        if (pre_address == -1) return BlockHandle();
+        //the last block under it
+        while (!pre_is_block) {
+            NodeHandle node = node_pool.Pin(pre_address, pre_depth <= resident_level);
+            pre_address = node->key[node->size - 1].address;
+            pre_is_block = node->son_is_block;
+            ++pre_depth;
+        }
+        return PinBlock(pre_address);
+    }
+
+    /*
+     * borrow or merge for the underfull pages on the path to target, bottom up
+     * again while anything changes, as a merge of two sparse pages may still be under half
+     * return false if nothing is changed
+     */
+    bool Rebalance(const KeyGroup &target) {
+        bool changed = false;
+        while (root_node.size) {
+            NodeHandle current(&root_node, root);
+            if (!RebalanceNode(target, current, 0)) break;
+            changed = true;
+        }
+        return changed;
+    }
+
+    //one round of Rebalance, a page without brothers is left as it is
+    bool RebalanceNode(const KeyGroup &target, NodeHandle &current, int depth) {
+        int index = BinarySearch(current->key, 0, current->size - 1, target);
+        if (index == -1) index = current->size - 1;
+        bool adjust_flag = true;
+        if (current->son_is_block) {
+            if (current->size == 1) return false;
+            BlockHandle block = PinBlock(current->key[index].address);
+            if (block->size >= min_block_fill) return false;
+            AdjustRemoveInBlock(block, current, index, adjust_flag);
+        } else {
+            NodeHandle son = SonNode(*current, index, depth + 1);
+            bool changed = RebalanceNode(target, son, depth + 1);
+            if (son->size * 2 >= node_size || current->size == 1) return changed;
+            AdjustRemoveInNode(son, current, index, depth + 1, adjust_flag);
+        }
+        current.MarkDirty();
+        return true;
+    }
 };
 
-#endif //TICKETSYSTEM_BPT_HPP
\ No newline at end of file
+#endif //TICKETSYSTEM_BPT_HPP
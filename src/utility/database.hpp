@@ -0,0 +1,145 @@
+/*
+ * DATABASE
+ * many named trees in one file, opened as BPlusTree(database, name)
+ *
+ * the file begins with a catalog: the header of each tree by its name and the free lists of the file
+ * pages of all the trees follow, allocated from one PageSpace,
+ * so a page freed by one tree may be given to another one with pages of the same size
+ * frames of all the trees are counted in one MemoryBudget, the pages used longest ago go first,
+ * so the memory goes to the trees in use
+ *
+ * the catalog is kept in memory and written back by Flush and when destruct,
+ * trees must be destructed before their database
+ */
+
+#ifndef TICKETSYSTEM_DATABASE_HPP
+#define TICKETSYSTEM_DATABASE_HPP
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "page_handle.hpp"
+#include "memory_budget.hpp"
+
+class Database {
+public:
+    static constexpr int name_length = 48;
+    static constexpr int header_bytes = 128;//room for the header of a tree
+    static constexpr int max_tree = 64;
+    static constexpr int max_free_list = 32;
+
+private:
+    struct Entry {
+        char name[name_length];//empty: not used
+        char header[header_bytes];
+    };
+
+    struct Catalog {
+        char magic[4] = {'B', 'P', 'T', 'D'};
+        unsigned int version = 1;
+        int tree_num = 0;
+        int free_list_num = 0;
+        Entry entry[max_tree];
+        PageSpace::FreeList free_list[max_free_list];
+    };
+
+    std::string file_name;
+    std::fstream file;
+    Catalog *catalog;
+    PageSpace space;
+    MemoryBudget budget;
+
+public:
+    //memory_bytes: frames all the trees may hold together
+    explicit Database(const std::string &file_name, const long &memory_bytes = 256L << 20) :
+            file_name(file_name), catalog(new Catalog), space(file), budget(memory_bytes) {
+        memset(catalog->entry, 0, sizeof(catalog->entry));
+        file.open(file_name);
+        if (!file.good()) {//doesn't exist
+            file.open(file_name, std::ios::out);
+            file.close();
+            file.open(file_name);
+            Flush();
+            return;
+        }
+        file.read(reinterpret_cast<char *> (catalog), sizeof(Catalog));
+        for (int i = 0; i < catalog->free_list_num; ++i) {
+            const PageSpace::FreeList &list = catalog->free_list[i];
+            space.SetFreeList(list.bytes, list.head, list.num);
+        }
+    }
+
+    Database(const Database &) = delete;
+
+    Database &operator=(const Database &) = delete;
+
+    ~Database() {
+        Flush();
+        delete catalog;
+    }
+
+    //write the catalog
+    void Flush() {
+        catalog->free_list_num = space.FreeListNum() < max_free_list ? space.FreeListNum() : max_free_list;
+        for (int i = 0; i < catalog->free_list_num; ++i) catalog->free_list[i] = space.FreeListAt(i);
+        space.BeforeWrite(0, (long) sizeof(Catalog));
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *> (catalog), sizeof(Catalog));
+        file.flush();
+    }
+
+    /*
+     * index of the tree named name, a new entry with a zero header if there is none
+     * return -1 if the catalog is full
+     */
+    int OpenTree(const std::string &name, bool &is_new) {
+        is_new = false;
+        for (int i = 0; i < catalog->tree_num; ++i) {
+            if (!strncmp(catalog->entry[i].name, name.c_str(), name_length - 1)) return i;
+        }
+        if (catalog->tree_num == max_tree) return -1;
+        is_new = true;
+        Entry &entry = catalog->entry[catalog->tree_num];
+        strncpy(entry.name, name.c_str(), name_length - 1);
+        return catalog->tree_num++;
+    }
+
+    int TreeNum() const {
+        return catalog->tree_num;
+    }
+
+    const char *TreeName(int index) const {
+        return catalog->entry[index].name;
+    }
+
+    void ReadHeader(int index, void *header, size_t bytes) const {
+        memcpy(header, catalog->entry[index].header, bytes);
+    }
+
+    void WriteHeader(int index, const void *header, size_t bytes) {
+        memcpy(catalog->entry[index].header, header, bytes);
+    }
+
+    //writes to the file are kept by journal from now on, nullptr: no more, see WriteBatch
+    void SetJournal(Journal *journal) {
+        space.SetJournal(journal, file_name);
+    }
+
+    const std::string &FileName() const {
+        return file_name;
+    }
+
+    std::fstream &File() {
+        return file;
+    }
+
+    PageSpace &Space() {
+        return space;
+    }
+
+    MemoryBudget &Budget() {
+        return budget;
+    }
+};
+
+#endif //TICKETSYSTEM_DATABASE_HPP
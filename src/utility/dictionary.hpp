@@ -0,0 +1,172 @@
+/*
+ * DICTIONARY
+ * interns index strings: each distinct string gets a 32-bit id
+ * so a tree can be keyed on IdKey(id,value) instead of Key(index,value)
+ *
+ * file_name          strings, the one of id i is the i-th ele
+ * file_name + ".hash" open addressing table: slot[0] holds (count,capacity),
+ *                    other slots hold (id+1,hash of string), 0 for empty
+ *
+ * a string is cut to index_length-1 chars before it is hashed or stored, so longer ones with the same head are one
+ *
+ * ids are given in order of arrival, not in string order: the order of IdKey is not the order of Key,
+ * so a range over several indexes or a scan in order of an IdKey tree goes by id, not by string
+ * (strings interned together by InternAll into an empty dictionary get ids in string order)
+ *
+ * the table is kept in memory and written back when destruct,
+ * it is rebuilt from the strings if it doesn't match them
+ */
+
+#ifndef TICKETSYSTEM_DICTIONARY_HPP
+#define TICKETSYSTEM_DICTIONARY_HPP
+
+#include <cstring>
+#include <string>
+#include "file_manager.hpp"
+#include "parallel_sort.hpp"
+
+class Dictionary {
+public:
+    static constexpr int index_length = 64;
+
+private:
+    struct Entry {
+        char index[index_length];
+    };
+
+    struct Slot {
+        unsigned int id = 0;//id+1, 0 for empty
+        unsigned int hash = 0;
+    };
+
+    FileManager<Entry> r_w_entry;
+    FileManager<Slot> r_w_slot;
+
+    unsigned int count = 0;//number of strings
+    unsigned int capacity = 0;//number of slots, power of 2
+    Slot *slots = nullptr;
+    bool slot_changed = false;
+
+public:
+    explicit Dictionary(const std::string &file_name) : r_w_entry(file_name), r_w_slot(file_name + ".hash") {
+        Slot head;
+        long entry_num = r_w_entry.Size();
+        if (r_w_slot.Size() > 0) r_w_slot.ReadEle(0, head);
+        if (head.hash && head.id == entry_num && r_w_slot.Size() == head.hash + 1) {
+            count = head.id;
+            capacity = head.hash;
+            slots = new Slot[capacity];
+            r_w_slot.ReadEle(0, 1, (int) capacity, slots);
+        } else {
+            //new or broken table
+            count = (unsigned int) entry_num;
+            capacity = 1024;
+            while (capacity < count * 2) capacity <<= 1;
+            Rebuild();
+        }
+    }
+
+    ~Dictionary() {
+        if (slot_changed) {
+            Slot head;
+            head.id = count;
+            head.hash = capacity;
+            r_w_slot.WriteEle(0, 0, head);
+            r_w_slot.WriteEle(0, 1, (int) capacity, slots);
+        }
+        delete[] slots;
+    }
+
+    unsigned int Size() const {
+        return count;
+    }
+
+    //id of index, -1 if not interned
+    long Find(const char *index) {
+        unsigned int hash = Hash(index);
+        unsigned int pos = Probe(index, hash);
+        if (!slots[pos].id) return -1;
+        return slots[pos].id - 1;
+    }
+
+    //id of index, given a new id if not interned
+    unsigned int Intern(const char *index) {
+        unsigned int hash = Hash(index);
+        unsigned int pos = Probe(index, hash);
+        if (slots[pos].id) return slots[pos].id - 1;
+        Entry entry;
+        memset(entry.index, 0, sizeof(entry.index));
+        strncpy(entry.index, index, index_length - 1);
+        r_w_entry.WriteEle(entry);
+        slots[pos].id = ++count;
+        slots[pos].hash = hash;
+        slot_changed = true;
+        if (count * 2 > capacity) {
+            capacity <<= 1;
+            Rebuild();
+        }
+        return count - 1;
+    }
+
+    /*
+     * intern n strings, the new ones get ids in string order
+     * if the dictionary is empty, order of ids is the same as order of strings
+     * index is sorted in place
+     */
+    void InternAll(const char **index, long n) {
+        sjtu::ParallelSort(index, n, [](const char *a, const char *b) { return strcmp(a, b) < 0; }, 1);
+        for (long i = 0; i < n; ++i) Intern(index[i]);
+    }
+
+    //string of id, false if id doesn't exist
+    bool GetIndex(const unsigned int &id, char *index) {
+        if (id >= count) return false;
+        Entry entry;
+        r_w_entry.ReadEle(0, (int) id, entry);
+        strcpy(index, entry.index);
+        return true;
+    }
+
+private:
+    //FNV-1a of the chars stored, the same for index and the entry made of it
+    static unsigned int Hash(const char *index) {
+        unsigned int hash = 2166136261u;
+        for (int i = 0; i < index_length - 1 && index[i]; ++i) {
+            hash ^= (unsigned char) index[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    //slot holding index, or the empty slot where it should go
+    unsigned int Probe(const char *index, const unsigned int &hash) {
+        unsigned int pos = hash & (capacity - 1);
+        Entry entry;
+        while (slots[pos].id) {
+            if (slots[pos].hash == hash) {
+                r_w_entry.ReadEle(0, (int) slots[pos].id - 1, entry);
+                if (!strncmp(entry.index, index, index_length - 1)) return pos;
+            }
+            pos = (pos + 1) & (capacity - 1);
+        }
+        return pos;
+    }
+
+    //put every string into a table of capacity slots
+    void Rebuild() {
+        delete[] slots;
+        slots = new Slot[capacity];
+        Entry entry;
+        for (unsigned int id = 0; id < count; ++id) {
+            r_w_entry.ReadEle(0, (int) id, entry);
+            unsigned int hash = Hash(entry.index);
+            unsigned int pos = hash & (capacity - 1);
+            while (slots[pos].id) pos = (pos + 1) & (capacity - 1);
+            slots[pos].id = id + 1;
+            slots[pos].hash = hash;
+        }
+        slot_changed = true;
+    }
+};
+
+#endif //TICKETSYSTEM_DICTIONARY_HPP
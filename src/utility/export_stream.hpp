@@ -0,0 +1,211 @@
+/*
+ * EXPORT_STREAM
+ * a sorted sequence of (key,value) written to a stream, independent of the page layout of the tree
+ *
+ * header   magic "BPTX", version, bytes of Key and of Value
+ * chunks   (ele_num, byte_num) then byte_num bytes of at most chunk_size eles,
+ *          an ele is the bytes of key then value, coded against the ele before it in the chunk
+ *          (the first one against zero bytes) as runs: (equal bytes, new bytes, the new bytes)
+ *          so a shared prefix of keys and unchanged padding cost almost nothing
+ * end      a chunk of 0 ele, then the total number of eles
+ *
+ * each chunk is decoded on its own, numbers in runs are varints
+ */
+
+#ifndef TICKETSYSTEM_EXPORT_STREAM_HPP
+#define TICKETSYSTEM_EXPORT_STREAM_HPP
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+//eles in a chunk at most
+constexpr int export_chunk_size = 4096;
+
+struct ExportHeader {
+    char magic[4] = {'B', 'P', 'T', 'X'};
+    unsigned int version = 1;
+    unsigned int key_bytes = 0;
+    unsigned int value_bytes = 0;
+};
+
+template<class Key, class Value>
+class ExportWriter {
+    static constexpr int ele_bytes = (int) (sizeof(Key) + sizeof(Value));
+    static constexpr int chunk_size = export_chunk_size;
+
+    std::ostream *out;
+    std::string chunk;//coded eles of the chunk being filled
+    unsigned int chunk_num = 0;//eles in it
+    char last[ele_bytes];//bytes of the ele before
+    long long total = 0;
+
+public:
+    explicit ExportWriter(std::ostream &out) : out(&out) {
+        ExportHeader header;
+        header.key_bytes = sizeof(Key);
+        header.value_bytes = sizeof(Value);
+        out.write(reinterpret_cast<const char *> (&header), sizeof(header));
+        memset(last, 0, sizeof(last));
+    }
+
+    void Put(const Key &key, const Value &value) {
+        char ele[ele_bytes];
+        memcpy(ele, &key, sizeof(Key));
+        memcpy(ele + sizeof(Key), &value, sizeof(Value));
+        int i = 0;
+        while (i < ele_bytes) {
+            int begin = i;
+            while (i < ele_bytes && ele[i] == last[i]) ++i;
+            int equal = i - begin;
+            begin = i;
+            //a run of new bytes ends at 3 equal bytes, a shorter one costs more to code than to copy
+            while (i < ele_bytes && !(ele[i] == last[i] && (i + 2 >= ele_bytes ||
+                                                            (ele[i + 1] == last[i + 1] && ele[i + 2] == last[i + 2])))) {
+                ++i;
+            }
+            PutNumber((unsigned long) equal);
+            PutNumber((unsigned long) (i - begin));
+            chunk.append(ele + begin, i - begin);
+        }
+        memcpy(last, ele, sizeof(ele));
+        ++total;
+        if (++chunk_num == chunk_size) Flush();
+    }
+
+    //write the chunk left and the end, return the number of eles
+    long long Finish() {
+        Flush();
+        unsigned int end[2] = {0, 0};
+        out->write(reinterpret_cast<const char *> (end), sizeof(end));
+        out->write(reinterpret_cast<const char *> (&total), sizeof(total));
+        out->flush();
+        return total;
+    }
+
+private:
+    void PutNumber(unsigned long number) {
+        while (number >= 0x80) {
+            chunk.push_back((char) ((number & 0x7f) | 0x80));
+            number >>= 7;
+        }
+        chunk.push_back((char) number);
+    }
+
+    void Flush() {
+        if (!chunk_num) return;
+        unsigned int head[2] = {chunk_num, (unsigned int) chunk.size()};
+        out->write(reinterpret_cast<const char *> (head), sizeof(head));
+        out->write(chunk.data(), (std::streamsize) chunk.size());
+        chunk.clear();
+        chunk_num = 0;
+        memset(last, 0, sizeof(last));
+    }
+};
+
+template<class Key, class Value>
+class ExportReader {
+    static constexpr int ele_bytes = (int) (sizeof(Key) + sizeof(Value));
+    static constexpr int chunk_size = export_chunk_size;
+    //the bytes of an ele and two varints of at most 10 bytes
+    static constexpr long max_ele_code = ele_bytes + 2 * 10;
+
+    std::istream *in;
+    std::string chunk;
+    size_t pos = 0;//next byte to decode in chunk
+    unsigned int chunk_left = 0;//eles not decoded in chunk
+    char last[ele_bytes];
+    long long total = 0;
+    bool good = true;
+    bool end = false;
+
+public:
+    //the header is checked, Good is false if the stream is not an export of the same Key and Value
+    explicit ExportReader(std::istream &in) : in(&in) {
+        ExportHeader header, expect;
+        in.read(reinterpret_cast<char *> (&header), sizeof(header));
+        good = in.good() && !memcmp(header.magic, expect.magic, sizeof(header.magic)) &&
+               header.version == expect.version && header.key_bytes == sizeof(Key) &&
+               header.value_bytes == sizeof(Value);
+        memset(last, 0, sizeof(last));
+    }
+
+    bool Good() const {
+        return good;
+    }
+
+    //the next ele, false at the end or if the stream is broken (then Good is false)
+    bool Next(Key &key, Value &value) {
+        if (!good || end) return false;
+        if (!chunk_left && !ReadChunk()) return false;
+        char ele[ele_bytes];
+        int i = 0;
+        while (i < ele_bytes) {
+            unsigned long equal, fresh;
+            //each number is checked on its own, a sum of two could wrap around
+            if (!GetNumber(equal) || !GetNumber(fresh) || equal > (unsigned long) (ele_bytes - i) ||
+                fresh > (unsigned long) (ele_bytes - i) - equal || fresh > chunk.size() - pos) {
+                good = false;
+                return false;
+            }
+            memcpy(ele + i, last + i, equal);
+            i += (int) equal;
+            memcpy(ele + i, chunk.data() + pos, fresh);
+            i += (int) fresh;
+            pos += fresh;
+        }
+        if (!--chunk_left && pos != chunk.size()) {//bytes left after the last ele of the chunk
+            good = false;
+            return false;
+        }
+        memcpy(last, ele, sizeof(ele));
+        memcpy(reinterpret_cast<char *> (&key), ele, sizeof(Key));
+        memcpy(reinterpret_cast<char *> (&value), ele + sizeof(Key), sizeof(Value));
+        ++total;
+        return true;
+    }
+
+private:
+    bool GetNumber(unsigned long &number) {
+        number = 0;
+        for (int shift = 0; pos < chunk.size() && shift < 64; shift += 7) {
+            unsigned char byte = (unsigned char) chunk[pos++];
+            number |= (unsigned long) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool ReadChunk() {
+        unsigned int head[2];
+        in->read(reinterpret_cast<char *> (head), sizeof(head));
+        if (!in->good()) {
+            good = false;
+            return false;
+        }
+        if (!head[0]) {//end, the count must match
+            long long expect = -1;
+            in->read(reinterpret_cast<char *> (&expect), sizeof(expect));
+            good = in->good() && expect == total;
+            end = true;
+            return false;
+        }
+        //a chunk of the writer holds at most chunk_size eles, each coded in at most max_ele_code bytes
+        if (head[0] > (unsigned int) chunk_size || (long) head[1] > chunk_size * max_ele_code) {
+            good = false;
+            return false;
+        }
+        chunk.resize(head[1]);
+        in->read(&chunk[0], head[1]);
+        if (!in->good()) {
+            good = false;
+            return false;
+        }
+        pos = 0;
+        chunk_left = head[0];
+        memset(last, 0, sizeof(last));
+        return true;
+    }
+};
+
+#endif //TICKETSYSTEM_EXPORT_STREAM_HPP
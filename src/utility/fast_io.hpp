@@ -0,0 +1,143 @@
+/*
+ * FAST_IO
+ * buffered input and output on file descriptors, for many short commands
+ * input is read in large blocks and cut into tokens by hand,
+ * output is kept in one buffer and written when it is full or on Flush
+ */
+
+#ifndef TICKETSYSTEM_FAST_IO_HPP
+#define TICKETSYSTEM_FAST_IO_HPP
+
+#include <cerrno>
+#include <unistd.h>
+
+class FastInput {
+    static constexpr int buffer_size = 1 << 20;
+
+    int fd;
+    char *buffer;
+    int pos = 0, end = 0;//unread bytes are [pos,end)
+
+public:
+    explicit FastInput(int fd = 0) : fd(fd), buffer(new char[buffer_size]) {}
+
+    FastInput(const FastInput &) = delete;
+
+    FastInput &operator=(const FastInput &) = delete;
+
+    ~FastInput() {
+        delete[] buffer;
+    }
+
+    /*
+     * the next token of non-blank chars into token, at most capacity-1 of them and a '\0'
+     * chars beyond that are skipped, return its length, 0 at the end of input
+     */
+    int Token(char *token, int capacity) {
+        int c = SkipBlank();
+        int length = 0;
+        while (c > ' ') {
+            if (length < capacity - 1) token[length++] = (char) c;
+            c = Get();
+        }
+        token[length] = '\0';
+        return length;
+    }
+
+    //the next integer, return false at the end of input
+    template<class Int>
+    bool Number(Int &number) {
+        int c = SkipBlank();
+        if (c == -1) return false;
+        bool negative = c == '-';
+        if (negative || c == '+') c = Get();
+        number = 0;
+        while (c >= '0' && c <= '9') {
+            number = number * 10 + (c - '0');
+            c = Get();
+        }
+        if (negative) number = -number;
+        return true;
+    }
+
+private:
+    //next byte, -1 at the end of input
+    int Get() {
+        if (pos == end) {
+            long got;
+            do {
+                got = read(fd, buffer, buffer_size);
+            } while (got < 0 && errno == EINTR);
+            if (got <= 0) return -1;
+            pos = 0;
+            end = (int) got;
+        }
+        return (unsigned char) buffer[pos++];
+    }
+
+    //first non-blank byte, -1 at the end of input
+    int SkipBlank() {
+        int c = Get();
+        while (c != -1 && c <= ' ') c = Get();
+        return c;
+    }
+};
+
+class FastOutput {
+    static constexpr int buffer_size = 1 << 20;
+
+    int fd;
+    char *buffer;
+    int size = 0;
+
+public:
+    explicit FastOutput(int fd = 1) : fd(fd), buffer(new char[buffer_size]) {}
+
+    FastOutput(const FastOutput &) = delete;
+
+    FastOutput &operator=(const FastOutput &) = delete;
+
+    ~FastOutput() {
+        Flush();
+        delete[] buffer;
+    }
+
+    void Put(char c) {
+        if (size == buffer_size) Flush();
+        buffer[size++] = c;
+    }
+
+    void Put(const char *str) {
+        while (*str) Put(*str++);
+    }
+
+    template<class Int>
+    void Number(Int number) {
+        char digits[24];
+        int length = 0;
+        //negative digits, so the smallest number doesn't overflow
+        bool negative = number < 0;
+        if (!negative) number = -number;
+        do {
+            digits[length++] = (char) ('0' - number % 10);
+            number /= 10;
+        } while (number);
+        if (negative) Put('-');
+        while (length) Put(digits[--length]);
+    }
+
+    void Flush() {
+        int done = 0;
+        while (done < size) {
+            long written = write(fd, buffer + done, size - done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            done += (int) written;
+        }
+        size = 0;
+    }
+};
+
+#endif //TICKETSYSTEM_FAST_IO_HPP
@@ -49,6 +49,23 @@ public:
         return addr;
     }
 
+    //read num successive eles from start_addr into array
+    void ReadEle(const long &start_addr, const int &move_num, const int &num, ValueType *array) {
+        r_w_file.seekg(start_addr + move_num * value_size);
+        r_w_file.read(reinterpret_cast<char *> (array), num * value_size);
+    }
+
+    void WriteEle(const long &start_addr, const int &move_num, const int &num, const ValueType *array) {
+        r_w_file.seekp(start_addr + move_num * value_size);
+        r_w_file.write(reinterpret_cast<const char *> (array), num * value_size);
+    }
+
+    //number of eles stored in the file
+    long Size() {
+        r_w_file.seekg(0, std::ios::end);
+        return (long) r_w_file.tellg() / (long) value_size;
+    }
+
     long WriteEle(ValueType valueType) {
         r_w_file.seekp(0, std::ios::end);
         long addr = r_w_file.tellp();
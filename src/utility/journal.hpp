@@ -0,0 +1,258 @@
+/*
+ * JOURNAL
+ * the bytes a WriteBatch overwrites in the files of its trees, kept before they are overwritten,
+ * so a batch cut by a crash is undone when the files are opened again
+ *
+ * file     JournalHead, then records, each a RecordHead and its bytes
+ *          file     a file written by the batch: its size before, the bytes are its name
+ *          image    bytes of a file before the batch wrote them
+ *          commit   the batch is done and the files hold it all, the journal is removed then
+ * an image is written to the journal before the bytes it keeps are overwritten,
+ * bytes past the size a file had before are not kept, the file is cut back to that size instead
+ *
+ * records are flushed to the system one by one, the files of the trees are flushed before commit,
+ * so a batch survives its process being killed, not the machine losing power (nothing is synced)
+ */
+
+#ifndef TICKETSYSTEM_JOURNAL_HPP
+#define TICKETSYSTEM_JOURNAL_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "vector.hpp"
+
+class Journal {
+    enum RecordType {
+        record_file = 1, record_image, record_commit
+    };
+
+    struct JournalHead {
+        char magic[4] = {'B', 'P', 'T', 'J'};
+        unsigned int version = 1;
+    };
+
+    struct RecordHead {
+        int type = 0;
+        int file = 0;//index of the file record
+        long address = 0;//of the image, size before for a file record
+        long bytes = 0;//after the head
+    };
+
+    struct File {
+        std::string name;
+        std::fstream *stream;
+        long size;//before the batch
+    };
+
+    //bytes of a file already kept, found by a hash of (file,address)
+    struct Span {
+        int file;
+        long address;
+        long bytes;
+    };
+
+    std::string file_name;
+    std::ofstream journal;
+    sjtu::vector<File> files;
+    sjtu::vector<Span> spans;
+    int *slot = nullptr;//index of a span + 1, 0: empty
+    int slot_num = 0;
+    char *buffer = nullptr;
+    long buffer_bytes = 0;
+    bool committed = false;
+
+public:
+    explicit Journal(const std::string &file_name) :
+            file_name(file_name), journal(file_name, std::ios::binary | std::ios::trunc) {
+        JournalHead head;
+        journal.write(reinterpret_cast<const char *> (&head), sizeof(head));
+        journal.flush();
+        slot_num = 64;
+        slot = new int[slot_num]();
+    }
+
+    Journal(const Journal &) = delete;
+
+    Journal &operator=(const Journal &) = delete;
+
+    //a journal not committed is left for Recover
+    ~Journal() {
+        delete[] slot;
+        delete[] buffer;
+    }
+
+    bool Good() const {
+        return journal.good();
+    }
+
+    /*
+     * writes to stream are kept from now on, return the index of the file
+     * the stream must be flushed, so its size is the size on disk
+     */
+    int AddFile(const std::string &name, std::fstream &stream) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (files[i].stream == &stream) return (int) i;
+        }
+        stream.seekg(0, std::ios::end);
+        File file{name, &stream, (long) stream.tellg()};
+        files.push_back(file);
+        RecordHead head;
+        head.type = record_file;
+        head.file = (int) files.size() - 1;
+        head.address = file.size;
+        head.bytes = (long) name.size();
+        Put(head, name.data());
+        return head.file;
+    }
+
+    //bytes at address of file are about to be written, keep what they are now if it is the first time
+    void Keep(int file, const long &address, long bytes) {
+        File &target = files[file];
+        if (address >= target.size) return;//cut back by Recover
+        if (address + bytes > target.size) bytes = target.size - address;
+        int *iter = Find(file, address);
+        if (*iter && spans[*iter - 1].bytes >= bytes) return;
+        if (buffer_bytes < bytes) {
+            delete[] buffer;
+            buffer = new char[bytes];
+            buffer_bytes = bytes;
+        }
+        target.stream->seekg(address);
+        target.stream->read(buffer, bytes);
+        RecordHead head;
+        head.type = record_image;
+        head.file = file;
+        head.address = address;
+        head.bytes = bytes;
+        Put(head, buffer);
+        if (*iter) {
+            spans[*iter - 1].bytes = bytes;
+            return;
+        }
+        Span span{file, address, bytes};
+        spans.push_back(span);
+        *iter = (int) spans.size();
+        if ((long) spans.size() * 2 > slot_num) Rehash();
+    }
+
+    //the files hold the whole batch: write the commit record, then remove the journal
+    void Commit() {
+        RecordHead head;
+        head.type = record_commit;
+        Put(head, nullptr);
+        journal.close();
+        std::remove(file_name.c_str());
+        committed = true;
+    }
+
+    bool Committed() const {
+        return committed;
+    }
+
+    /*
+     * undo the batch of the journal at file_name if it has no commit record, then remove the journal
+     * call it before the trees written by the batch are opened
+     * return true if a batch is undone
+     */
+    static bool Recover(const std::string &file_name) {
+        std::ifstream in(file_name, std::ios::binary);
+        if (!in) return false;
+        JournalHead head, expect;
+        in.read(reinterpret_cast<char *> (&head), sizeof(head));
+        if (!in.good() || memcmp(head.magic, expect.magic, sizeof(head.magic)) || head.version != expect.version) {
+            in.close();
+            std::remove(file_name.c_str());//cut before its head, nothing was written by the batch
+            return false;
+        }
+        sjtu::vector<File> files;
+        sjtu::vector<RecordHead> images;
+        sjtu::vector<long> offsets;//of the bytes of images in the journal
+        bool committed = false;
+        RecordHead record;
+        while (in.read(reinterpret_cast<char *> (&record), sizeof(record))) {
+            if (record.type == record_commit) {
+                committed = true;
+                break;
+            }
+            if (record.bytes < 0 || (record.type != record_file && record.type != record_image)) break;
+            if (record.type == record_file) {
+                std::string name((size_t) record.bytes, '\0');
+                if (!in.read(&name[0], record.bytes)) break;
+                File file{name, nullptr, record.address};
+                files.push_back(file);
+                continue;
+            }
+            if (record.file < 0 || record.file >= (int) files.size()) break;
+            offsets.push_back((long) in.tellg());
+            in.seekg(record.bytes, std::ios::cur);
+            if (!in.good()) {//cut by the crash, its bytes were not overwritten yet
+                offsets.pop_back();
+                break;
+            }
+            images.push_back(record);
+        }
+        in.clear();
+        if (!committed) {
+            //the first image of some bytes is the oldest, so images are put back from the last one
+            char *buffer = nullptr;
+            long buffer_bytes = 0;
+            for (size_t i = 0; i < files.size(); ++i) files[i].stream = new std::fstream(files[i].name);
+            for (long i = (long) images.size() - 1; i >= 0; --i) {
+                const RecordHead &image = images[i];
+                if (buffer_bytes < image.bytes) {
+                    delete[] buffer;
+                    buffer = new char[image.bytes];
+                    buffer_bytes = image.bytes;
+                }
+                in.seekg(offsets[i]);
+                in.read(buffer, image.bytes);
+                std::fstream &file = *files[image.file].stream;
+                file.seekp(image.address);
+                file.write(buffer, image.bytes);
+            }
+            delete[] buffer;
+            for (size_t i = 0; i < files.size(); ++i) {
+                delete files[i].stream;
+                if (truncate(files[i].name.c_str(), files[i].size) != 0) return true;//left to be recovered again
+            }
+        }
+        in.close();
+        std::remove(file_name.c_str());
+        return !committed;
+    }
+
+private:
+    void Put(const RecordHead &head, const char *bytes) {
+        journal.write(reinterpret_cast<const char *> (&head), sizeof(head));
+        if (head.bytes) journal.write(bytes, head.bytes);
+        journal.flush();//before the bytes kept are overwritten
+    }
+
+    int Hash(int file, const long &address) const {
+        unsigned long h = ((unsigned long) address * 0x9E3779B97F4A7C15ul) ^ (unsigned long) file;
+        return (int) (h >> 32) & (slot_num - 1);
+    }
+
+    //the slot of (file,address), or the empty slot where it goes
+    int *Find(int file, const long &address) {
+        int h = Hash(file, address);
+        while (slot[h]) {
+            const Span &span = spans[slot[h] - 1];
+            if (span.file == file && span.address == address) break;
+            h = (h + 1) & (slot_num - 1);
+        }
+        return &slot[h];
+    }
+
+    void Rehash() {
+        delete[] slot;
+        slot_num <<= 1;
+        slot = new int[slot_num]();
+        for (size_t i = 0; i < spans.size(); ++i) *Find(spans[i].file, spans[i].address) = (int) i + 1;
+    }
+};
+
+#endif //TICKETSYSTEM_JOURNAL_HPP
@@ -0,0 +1,109 @@
+/*
+ * MEMORY_BUDGET
+ * bytes of pages cached in memory by all the page caches of the process
+ * each cache registers itself, when the process is over budget
+ * the least recently used page of all the caches is given up first,
+ * so the memory goes to the caches in use, e.g. the hot index among many trees
+ */
+
+#ifndef TICKETSYSTEM_MEMORY_BUDGET_HPP
+#define TICKETSYSTEM_MEMORY_BUDGET_HPP
+
+class MemoryBudget;
+
+//what MemoryBudget needs to know about a cache
+class CacheBase {
+    friend class MemoryBudget;
+
+    CacheBase *pre_cache = nullptr, *next_cache = nullptr;//registered caches are linked
+
+protected:
+    long used = 0;//bytes of frames held now
+
+public:
+    virtual ~CacheBase() = default;
+
+    long Used() const {
+        return used;
+    }
+
+    //drop the least recently used unpinned page, return false if there is none
+    virtual bool EvictOne() = 0;
+
+    //Tick of the last use of that page, -1 if there is none
+    virtual long OldestUse() const = 0;
+};
+
+class MemoryBudget {
+    long limit;//-1: no limit
+    long used = 0;
+    long clock = 0;//number of uses of pages, orders them over all the caches
+    CacheBase *head = nullptr;
+
+public:
+    explicit MemoryBudget(const long &limit = -1) : limit(limit) {}
+
+    MemoryBudget(const MemoryBudget &) = delete;
+
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    //shared by every tree of the process unless told otherwise
+    static MemoryBudget &Process() {
+        static MemoryBudget budget(1L << 30);
+        return budget;
+    }
+
+    long Limit() const {
+        return limit;
+    }
+
+    long Used() const {
+        return used;
+    }
+
+    void SetLimit(const long &new_limit) {
+        limit = new_limit;
+        Reclaim();
+    }
+
+    void Register(CacheBase *cache) {
+        cache->pre_cache = nullptr;
+        cache->next_cache = head;
+        if (head) head->pre_cache = cache;
+        head = cache;
+    }
+
+    void Unregister(CacheBase *cache) {
+        if (cache->pre_cache) cache->pre_cache->next_cache = cache->next_cache;
+        else head = cache->next_cache;
+        if (cache->next_cache) cache->next_cache->pre_cache = cache->pre_cache;
+        cache->pre_cache = cache->next_cache = nullptr;
+    }
+
+    void Charge(const long &bytes) {
+        used += bytes;
+    }
+
+    //a page is used now
+    long Tick() {
+        return ++clock;
+    }
+
+    //evict until used <= limit, the page used longest ago goes first
+    void Reclaim() {
+        while (limit >= 0 && used > limit) {
+            CacheBase *victim = nullptr;
+            long victim_use = 0;
+            for (CacheBase *cache = head; cache; cache = cache->next_cache) {
+                long use = cache->OldestUse();
+                if (use >= 0 && (!victim || use < victim_use)) {
+                    victim = cache;
+                    victim_use = use;
+                }
+            }
+            if (!victim || !victim->EvictOne()) return;//only pinned pages are left
+        }
+    }
+};
+
+#endif //TICKETSYSTEM_MEMORY_BUDGET_HPP
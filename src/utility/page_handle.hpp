@@ -0,0 +1,616 @@
+/*
+ * PAGE_HANDLE
+ * a page pinned in memory: pointer to the page, its address in file and a dirty flag
+ * frames of pages come from a PagePool and go back to it when the handle is released
+ * so reading or writing a page never copies it, and no page lives on the stack
+ *
+ * a page pinned with keep stays cached in the pool after release, until it is evicted or dropped,
+ * pinning it again without keep doesn't change that,
+ * it is written back when evicted or when the pool is flushed,
+ * other pages are written back (if dirty) at release
+ *
+ * a handle may also point to a page resident in the tree (root_node),
+ * such page is written back by the tree itself, never by the handle
+ *
+ * freed pages are linked into a free list and given out again before the file grows
+ * the end of a file and its free lists (one for each size of page) are kept by a PageSpace,
+ * a pool owns the space of its file, or shares one with the other pools on the same file
+ *
+ * while a journal is set on a space (by a WriteBatch), every write to its file is kept by the journal first
+ */
+
+#ifndef TICKETSYSTEM_PAGE_HANDLE_HPP
+#define TICKETSYSTEM_PAGE_HANDLE_HPP
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "journal.hpp"
+#include "vector.hpp"
+#include "memory_budget.hpp"
+
+template<class Page>
+class PageHandle;
+
+//where pages of a file are allocated: the end of the file and a free list for each size of page
+class PageSpace {
+public:
+    struct FreeList {
+        long bytes = 0;//size of the pages
+        long head = -1;//freed pages are linked through their first bytes, -1: none
+        long num = 0;
+    };
+
+private:
+    std::fstream *file;
+    long file_end = -1;//new pages are allocated here, -1 before first allocation
+    sjtu::vector<FreeList> free_lists;
+    Journal *journal = nullptr;
+    int journal_file = -1;//index of the file in journal
+
+public:
+    explicit PageSpace(std::fstream &file) : file(&file) {}
+
+    PageSpace(const PageSpace &) = delete;
+
+    PageSpace &operator=(const PageSpace &) = delete;
+
+    std::fstream &File() const {
+        return *file;
+    }
+
+    /*
+     * reserve num successive pages of bytes, return address of the first one
+     * a single page is taken from the freed ones first, otherwise pages come from the end of the file
+     */
+    long Allocate(const long &bytes, const long &num) {
+        FreeList &list = List(bytes);
+        if (num == 1 && list.head != -1) {
+            long address = list.head;
+            file->seekg(address);
+            file->read(reinterpret_cast<char *> (&list.head), sizeof(list.head));
+            --list.num;
+            return address;
+        }
+        return Reserve(num * bytes);
+    }
+
+    //bytes at the end of the file, return the address
+    long Reserve(const long &bytes) {
+        long address = FileEnd();
+        file_end += bytes;
+        return address;
+    }
+
+    //bytes of the file, pages allocated but not written yet included
+    long FileEnd() {
+        if (file_end < 0) {
+            file->seekp(0, std::ios::end);
+            file_end = file->tellp();
+        }
+        return file_end;
+    }
+
+    //the page of bytes at address is dead, it will be given out again by Allocate
+    void Free(const long &address, const long &bytes) {
+        FreeList &list = List(bytes);
+        BeforeWrite(address, (long) sizeof(list.head));
+        file->seekp(address);
+        file->write(reinterpret_cast<const char *> (&list.head), sizeof(list.head));
+        if (address + bytes == file_end) {
+            //the last page may never be written, the file must cover it or pages allocated after reopen are misplaced
+            char end = 0;
+            BeforeWrite(file_end - 1, 1);
+            file->seekp(file_end - 1);
+            file->write(&end, 1);
+        }
+        list.head = address;
+        ++list.num;
+    }
+
+    //free lists are stored by the owner of the file
+    const FreeList &Free(const long &bytes) {
+        return List(bytes);
+    }
+
+    void SetFreeList(const long &bytes, const long &head, const long &num) {
+        FreeList &list = List(bytes);
+        list.head = head;
+        list.num = num;
+    }
+
+    int FreeListNum() const {
+        return (int) free_lists.size();
+    }
+
+    const FreeList &FreeListAt(int index) const {
+        return free_lists[index];
+    }
+
+    //writes to the file named file_name are kept by journal from now on, nullptr: no more
+    void SetJournal(Journal *journal, const std::string &file_name) {
+        this->journal = journal;
+        if (!journal) return;
+        file->flush();
+        journal_file = journal->AddFile(file_name, *file);
+    }
+
+    //bytes at address are about to be written
+    void BeforeWrite(const long &address, const long &bytes) {
+        if (journal) journal->Keep(journal_file, address, bytes);
+    }
+
+    //forget the end of the file and the free lists, e.g. the file is replaced
+    void Clear() {
+        file_end = -1;
+        free_lists.clear();
+    }
+
+private:
+    FreeList &List(const long &bytes) {
+        for (size_t i = 0; i < free_lists.size(); ++i) {
+            if (free_lists[i].bytes == bytes) return free_lists[i];
+        }
+        FreeList list;
+        list.bytes = bytes;
+        free_lists.push_back(list);
+        return free_lists[free_lists.size() - 1];
+    }
+};
+
+//frames of one kind of page in one file
+template<class Page>
+class PagePool : public CacheBase {
+public:
+    struct Frame {
+        Page page;
+        long address = -1;
+        int pin = 0;//number of handles holding it
+        bool dirty = false;
+        bool keep = false;//stay cached after unpinned
+        long last_use = 0;//Tick of the budget when it was unpinned
+        Frame *hash_next = nullptr;
+        Frame *lru_pre = nullptr, *lru_next = nullptr;//unpinned cached frames, most recent first
+    };
+
+private:
+    static constexpr int max_free_frame = 8;
+
+    PageSpace own_space;
+    PageSpace *space;
+    std::fstream *file;
+    long page_num = 0;//pages allocated and not freed
+
+    //address -> frame
+    Frame **bucket = nullptr;
+    int bucket_num = 0;
+    int frame_num = 0;
+
+    Frame *lru_head = nullptr, *lru_tail = nullptr;
+    sjtu::vector<Frame *> free_frames;
+
+    long limit = -1;//bytes this pool may hold, -1: no limit
+    MemoryBudget *budget;
+
+public:
+    explicit PagePool(std::fstream &file, MemoryBudget &budget = MemoryBudget::Process()) :
+            own_space(file), space(&own_space), file(&file), budget(&budget) {
+        bucket_num = 16;
+        bucket = new Frame *[bucket_num]();
+        budget.Register(this);
+    }
+
+    //pages are allocated in a space shared with other pools on its file
+    PagePool(PageSpace &shared, MemoryBudget &budget) :
+            own_space(shared.File()), space(&shared), file(&shared.File()), budget(&budget) {
+        bucket_num = 16;
+        bucket = new Frame *[bucket_num]();
+        budget.Register(this);
+    }
+
+    PagePool(const PagePool &) = delete;
+
+    PagePool &operator=(const PagePool &) = delete;
+
+    ~PagePool() override {
+        Flush();
+        for (int i = 0; i < bucket_num; ++i) {
+            Frame *frame = bucket[i];
+            while (frame) {
+                Frame *next = frame->hash_next;
+                delete frame;
+                frame = next;
+            }
+        }
+        delete[] bucket;
+        for (size_t i = 0; i < free_frames.size(); ++i) delete free_frames[i];
+        budget->Charge(-used);
+        budget->Unregister(this);
+    }
+
+    //bytes of frames this pool may hold, pages over it are evicted, least recently used first
+    void SetLimit(const long &bytes) {
+        limit = bytes;
+        Shrink();
+    }
+
+    long Limit() const {
+        return limit;
+    }
+
+    static constexpr long FrameSize() {
+        return (long) sizeof(Frame);
+    }
+
+    //page at address, read from file if it is not cached
+    PageHandle<Page> Pin(const long &address, bool keep = false) {
+        Frame *frame = Lookup(address);
+        if (frame) {
+            if (!frame->pin) LruRemove(frame);
+        } else {
+            frame = Acquire(address);
+            Read(frame->page, address);
+        }
+        ++frame->pin;
+        frame->keep = frame->keep || keep;//a plain pin doesn't take keep away, only eviction does
+        return PageHandle<Page>(this, frame);
+    }
+
+    //a new page at the end of the file, content of the frame is left as it is
+    PageHandle<Page> New(bool keep = false) {
+        return New(Allocate(), keep);
+    }
+
+    //a page at address whose content is going to be overwritten, so it is not read
+    PageHandle<Page> New(const long &address, bool keep = false) {
+        Frame *frame = Lookup(address);
+        if (frame) {
+            if (!frame->pin) LruRemove(frame);
+        } else frame = Acquire(address);
+        ++frame->pin;
+        frame->keep = frame->keep || keep;
+        frame->dirty = true;
+        return PageHandle<Page>(this, frame);
+    }
+
+    /*
+     * reserve num successive pages, return address of the first one
+     * a single page is taken from the freed ones first, otherwise pages come from the end of the file
+     */
+    long Allocate(const long &num = 1) {
+        page_num += num;
+        return space->Allocate((long) sizeof(Page), num);
+    }
+
+    //num successive pages at the end of the file, return address of the first one
+    long Reserve(const long &num) {
+        page_num += num;
+        return space->Reserve(num * (long) sizeof(Page));
+    }
+
+    //bytes of the file, pages allocated but not written yet included
+    long FileEnd() {
+        return space->FileEnd();
+    }
+
+    //a field at offset of the page at address, e.g. its size, the rest of the page is not read
+    template<class Field>
+    void ReadField(const long &address, const long &offset, Field &field) {
+        Frame *frame = Lookup(address);
+        if (frame) {
+            memcpy(&field, reinterpret_cast<const char *> (&frame->page) + offset, sizeof(Field));
+            return;
+        }
+        file->seekg(address + offset);
+        file->read(reinterpret_cast<char *> (&field), sizeof(Field));
+    }
+
+    //change a field at offset of the page at address, the rest of the page is not read or written
+    template<class Field>
+    void WriteField(const long &address, const long &offset, const Field &field) {
+        Frame *frame = Lookup(address);
+        if (frame) memcpy(reinterpret_cast<char *> (&frame->page) + offset, &field, sizeof(Field));
+        space->BeforeWrite(address + offset, (long) sizeof(Field));
+        file->seekp(address + offset);
+        file->write(reinterpret_cast<const char *> (&field), sizeof(Field));
+    }
+
+    void Read(Page &page, const long &address) {
+        file->seekg(address);
+        file->read(reinterpret_cast<char *> (&page), sizeof(Page));
+    }
+
+    void Write(const Page &page, const long &address) {
+        space->BeforeWrite(address, (long) sizeof(Page));
+        file->seekp(address);
+        file->write(reinterpret_cast<const char *> (&page), sizeof(Page));
+    }
+
+    //handle released
+    void Unpin(Frame *frame, bool dirty) {
+        if (dirty) frame->dirty = true;
+        if (--frame->pin) return;
+        if (frame->keep) {
+            LruPushFront(frame);
+            Shrink();
+        } else Evict(frame);
+    }
+
+    //the page is dead, forget it without writing
+    void Drop(Frame *frame) {
+        if (--frame->pin) return;
+        frame->dirty = false;
+        frame->keep = false;//not in lru
+        Evict(frame);
+    }
+
+    //the page at address is dead, it will be given out again by Allocate
+    void Free(const long &address) {
+        Frame *frame = Lookup(address);
+        if (frame && !frame->pin) {//a cached copy must not be written over the link
+            frame->dirty = false;
+            Evict(frame);
+        }
+        space->Free(address, (long) sizeof(Page));
+        --page_num;
+    }
+
+    //first freed page and number of freed pages of this size, stored by the owner of the file
+    long FreeHead() {
+        return space->Free((long) sizeof(Page)).head;
+    }
+
+    long FreeNum() {
+        return space->Free((long) sizeof(Page)).num;
+    }
+
+    void SetFreeList(const long &head, const long &num) {
+        space->SetFreeList((long) sizeof(Page), head, num);
+    }
+
+    PageSpace &Space() {
+        return *space;
+    }
+
+    //pages allocated by this pool and not freed, stored by the owner of the pool
+    long PageNum() const {
+        return page_num;
+    }
+
+    void SetPageNum(const long &num) {
+        page_num = num;
+    }
+
+    //forget every page without writing and start over, e.g. the file is replaced, no page may be pinned
+    void Clear() {
+        for (int i = 0; i < bucket_num; ++i) {
+            Frame *frame = bucket[i];
+            while (frame) {
+                Frame *next = frame->hash_next;
+                frame->dirty = false;
+                Evict(frame);
+                frame = next;
+            }
+        }
+        space->Clear();
+        page_num = 0;
+    }
+
+    //write back all dirty pages, they stay cached
+    void Flush() {
+        for (int i = 0; i < bucket_num; ++i) {
+            for (Frame *frame = bucket[i]; frame; frame = frame->hash_next) {
+                if (frame->dirty) {
+                    Write(frame->page, frame->address);
+                    frame->dirty = false;
+                }
+            }
+        }
+    }
+
+    bool EvictOne() override {
+        if (!lru_tail) return false;
+        Evict(lru_tail);
+        return true;
+    }
+
+    long OldestUse() const override {
+        return lru_tail ? lru_tail->last_use : -1;
+    }
+
+private:
+    int Hash(const long &address) const {
+        unsigned long h = (unsigned long) address * 0x9E3779B97F4A7C15ul;
+        return (int) (h >> 32) & (bucket_num - 1);
+    }
+
+    Frame *Lookup(const long &address) const {
+        for (Frame *frame = bucket[Hash(address)]; frame; frame = frame->hash_next) {
+            if (frame->address == address) return frame;
+        }
+        return nullptr;
+    }
+
+    void Rehash() {
+        Frame **old_bucket = bucket;
+        int old_num = bucket_num;
+        bucket_num <<= 1;
+        bucket = new Frame *[bucket_num]();
+        for (int i = 0; i < old_num; ++i) {
+            Frame *frame = old_bucket[i];
+            while (frame) {
+                Frame *next = frame->hash_next;
+                int h = Hash(frame->address);
+                frame->hash_next = bucket[h];
+                bucket[h] = frame;
+                frame = next;
+            }
+        }
+        delete[] old_bucket;
+    }
+
+    //a frame for address, put into hash, pin is 0
+    Frame *Acquire(const long &address) {
+        Frame *frame;
+        if (free_frames.empty()) frame = new Frame;
+        else {
+            frame = free_frames.back();
+            free_frames.pop_back();
+        }
+        frame->address = address;
+        frame->pin = 0;
+        frame->dirty = false;
+        if (++frame_num > bucket_num) Rehash();
+        int h = Hash(address);
+        frame->hash_next = bucket[h];
+        bucket[h] = frame;
+        used += FrameSize();
+        budget->Charge(FrameSize());
+        return frame;
+    }
+
+    //write back if dirty, take out of hash and lru
+    void Evict(Frame *frame) {
+        if (frame->dirty) Write(frame->page, frame->address);
+        if (!frame->pin && frame->keep) LruRemove(frame);
+        Frame **iter = &bucket[Hash(frame->address)];
+        while (*iter != frame) iter = &(*iter)->hash_next;
+        *iter = frame->hash_next;
+        --frame_num;
+        used -= FrameSize();
+        budget->Charge(-FrameSize());
+        frame->keep = false;
+        if ((int) free_frames.size() < max_free_frame) free_frames.push_back(frame);
+        else delete frame;
+    }
+
+    void LruRemove(Frame *frame) {
+        if (frame->lru_pre) frame->lru_pre->lru_next = frame->lru_next;
+        else lru_head = frame->lru_next;
+        if (frame->lru_next) frame->lru_next->lru_pre = frame->lru_pre;
+        else lru_tail = frame->lru_pre;
+        frame->lru_pre = frame->lru_next = nullptr;
+    }
+
+    void LruPushFront(Frame *frame) {
+        frame->last_use = budget->Tick();
+        frame->lru_pre = nullptr;
+        frame->lru_next = lru_head;
+        if (lru_head) lru_head->lru_pre = frame;
+        else lru_tail = frame;
+        lru_head = frame;
+    }
+
+    //keep within the limit of the pool and of the process
+    void Shrink() {
+        while (limit >= 0 && used > limit && lru_tail) Evict(lru_tail);
+        budget->Reclaim();
+    }
+};
+
+template<class Page>
+class PageHandle {
+    using Frame = typename PagePool<Page>::Frame;
+
+    PagePool<Page> *pool = nullptr;//nullptr: resident page, not owned by the handle
+    Frame *frame = nullptr;
+    Page *page = nullptr;
+    long address = -1;
+    bool dirty = false;
+
+public:
+    PageHandle() = default;
+
+    //resident page
+    PageHandle(Page *page, const long &address) : page(page), address(address) {}
+
+    PageHandle(PagePool<Page> *pool, Frame *frame) : pool(pool), frame(frame), page(&frame->page),
+                                                     address(frame->address) {}
+
+    PageHandle(const PageHandle &) = delete;
+
+    PageHandle &operator=(const PageHandle &) = delete;
+
+    PageHandle(PageHandle &&other) noexcept: pool(other.pool), frame(other.frame), page(other.page),
+                                             address(other.address), dirty(other.dirty) {
+        other.pool = nullptr;
+        other.frame = nullptr;
+        other.page = nullptr;
+        other.dirty = false;
+    }
+
+    PageHandle &operator=(PageHandle &&other) noexcept {
+        if (this == &other) return *this;
+        Release();
+        pool = other.pool;
+        frame = other.frame;
+        page = other.page;
+        address = other.address;
+        dirty = other.dirty;
+        other.pool = nullptr;
+        other.frame = nullptr;
+        other.page = nullptr;
+        other.dirty = false;
+        return *this;
+    }
+
+    ~PageHandle() {
+        Release();
+    }
+
+    Page *operator->() const {
+        return page;
+    }
+
+    Page &operator*() const {
+        return *page;
+    }
+
+    long Address() const {
+        return address;
+    }
+
+    bool Empty() const {
+        return page == nullptr;
+    }
+
+    bool IsResident() const {
+        return page != nullptr && pool == nullptr;
+    }
+
+    void MarkDirty() {
+        dirty = true;
+    }
+
+    //the page is dropped, give the frame back without writing
+    void Discard() {
+        if (pool) pool->Drop(frame);
+        Reset();
+    }
+
+    //the page is dead, drop it and give its address back to the pool to be reused
+    void Free() {
+        if (!pool) return;
+        PagePool<Page> *owner = pool;
+        long dead = address;
+        Discard();
+        owner->Free(dead);
+    }
+
+    //give the frame back to pool, dirty page is written back now or when it leaves the cache
+    void Release() {
+        if (pool) pool->Unpin(frame, dirty);
+        Reset();
+    }
+
+private:
+    void Reset() {
+        pool = nullptr;
+        frame = nullptr;
+        page = nullptr;
+        address = -1;
+        dirty = false;
+    }
+};
+
+#endif //TICKETSYSTEM_PAGE_HANDLE_HPP
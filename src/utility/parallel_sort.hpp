@@ -0,0 +1,78 @@
+/*
+ * PARALLEL_SORT
+ * stable merge sort on an array
+ * the array is cut into thread_num pieces sorted at the same time
+ * then pieces are merged pairwise, each round in parallel
+ */
+
+#ifndef TICKETSYSTEM_PARALLEL_SORT_HPP
+#define TICKETSYSTEM_PARALLEL_SORT_HPP
+
+#include <thread>
+
+namespace sjtu {
+
+    //merge [l,mid) and [mid,r) of from into to
+    template<class T, class Compare>
+    void MergeRange(T *from, T *to, long l, long mid, long r, const Compare &cmp) {
+        long i = l, j = mid, k = l;
+        while (i < mid && j < r) {
+            if (cmp(from[j], from[i])) to[k++] = from[j++];
+            else to[k++] = from[i++];
+        }
+        while (i < mid) to[k++] = from[i++];
+        while (j < r) to[k++] = from[j++];
+    }
+
+    //bottom-up merge sort of [l,r), tmp has the same size as array
+    template<class T, class Compare>
+    void MergeSort(T *array, T *tmp, long l, long r, const Compare &cmp) {
+        bool in_tmp = false;//where the sorted runs are now
+        for (long width = 1; width < r - l; width <<= 1) {
+            T *from = in_tmp ? tmp : array;
+            T *to = in_tmp ? array : tmp;
+            for (long i = l; i < r; i += width << 1) {
+                long mid = i + width < r ? i + width : r;
+                long end = mid + width < r ? mid + width : r;
+                MergeRange(from, to, i, mid, end, cmp);
+            }
+            in_tmp = !in_tmp;
+        }
+        if (in_tmp) {
+            for (long i = l; i < r; ++i) array[i] = tmp[i];
+        }
+    }
+
+    template<class T, class Compare>
+    void ParallelSort(T *array, long n, const Compare &cmp, int thread_num) {
+        if (n < 2) return;
+        if (thread_num < 1) thread_num = 1;
+        if (thread_num > n) thread_num = (int) n;
+        T *tmp = new T[n];
+        long *bound = new long[thread_num + 1];//piece i is [bound[i],bound[i+1])
+        for (int i = 0; i <= thread_num; ++i) bound[i] = n * i / thread_num;
+        std::thread *workers = new std::thread[thread_num];
+        for (int i = 0; i < thread_num; ++i) {
+            workers[i] = std::thread([=, &cmp]() { MergeSort(array, tmp, bound[i], bound[i + 1], cmp); });
+        }
+        for (int i = 0; i < thread_num; ++i) workers[i].join();
+        //merge pieces pairwise
+        for (int step = 1; step < thread_num; step <<= 1) {
+            int worker_num = 0;
+            for (int i = 0; i + step < thread_num; i += step << 1) {
+                long l = bound[i], mid = bound[i + step];
+                long r = bound[i + (step << 1) < thread_num ? i + (step << 1) : thread_num];
+                workers[worker_num++] = std::thread([=, &cmp]() {
+                    MergeRange(array, tmp, l, mid, r, cmp);
+                    for (long j = l; j < r; ++j) array[j] = tmp[j];
+                });
+            }
+            for (int i = 0; i < worker_num; ++i) workers[i].join();
+        }
+        delete[] workers;
+        delete[] bound;
+        delete[] tmp;
+    }
+}
+
+#endif //TICKETSYSTEM_PARALLEL_SORT_HPP
@@ -0,0 +1,379 @@
+/*
+ * SERVER
+ * the index of main served on a unix domain socket, so clients share one warm tree
+ *
+ * request  RequestHead, then lo_length bytes of index, then hi_length bytes of the second index (range)
+ *          insert/delete    index, value
+ *          find             index, every value of it
+ *          range            index lo..hi, at most value eles (<= 0: max_range),
+ *                           with after set it starts right after (lo, after_value) instead, see PutRangeAfter
+ *          stop             the server exits after this round, answers not written by then are dropped
+ * response ResponseHead, then count entries
+ *          insert/delete    status 1 if the tree changed
+ *          find             status 1 if found, int values
+ *          range            status 1 if more eles are left, (index length, index, int value) each
+ *                           the last of them is passed back (after, after_value) to get the next page
+ *
+ * a client may send many requests before reading, they are answered in order
+ * requests read from all the clients in one poll round are run together:
+ * a run of finds and ranges between two writes is searched in key order, so they share cached pages,
+ * then the answers are put back in the order of requests
+ */
+
+#ifndef TICKETSYSTEM_SERVER_HPP
+#define TICKETSYSTEM_SERVER_HPP
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "BPlusTree.hpp"
+#include "parallel_sort.hpp"
+#include "trace.hpp"
+#include "vector.hpp"
+#include "../head-file/key.hpp"
+
+enum RequestOp {
+    request_insert = 1, request_delete, request_find, request_range, request_stop
+};
+
+struct RequestHead {
+    unsigned char op = 0;
+    unsigned char lo_length = 0;
+    unsigned char hi_length = 0;
+    unsigned char after = 0;//range: go on after (lo, after_value)
+    int value = 0;
+    int after_value = 0;
+};
+
+struct ResponseHead {
+    unsigned char op = 0;
+    unsigned char status = 0;
+    unsigned short pad = 0;
+    unsigned int count = 0;
+};
+
+//a unix socket of path, -1 if it fails
+inline int ConnectServer(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr *> (&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//append a request to out, the index is cut to the length of Key::index
+inline void PutRequest(std::string &out, RequestOp op, const char *lo, int value, const char *hi = "") {
+    static constexpr size_t max_length = sizeof(Key().index) - 1;
+    RequestHead head;
+    head.op = (unsigned char) op;
+    size_t lo_length = strlen(lo), hi_length = strlen(hi);
+    head.lo_length = (unsigned char) (lo_length < max_length ? lo_length : max_length);
+    head.hi_length = (unsigned char) (hi_length < max_length ? hi_length : max_length);
+    head.value = value;
+    out.append(reinterpret_cast<const char *> (&head), sizeof(head));
+    out.append(lo, head.lo_length);
+    out.append(hi, head.hi_length);
+}
+
+//append a range request for the page after the ele (last, last_value), the last one of the page before
+inline void PutRangeAfter(std::string &out, const char *last, int last_value, const char *hi, int limit) {
+    size_t pos = out.size();
+    PutRequest(out, request_range, last, limit, hi);
+    RequestHead head;
+    memcpy(&head, out.data() + pos, sizeof(head));
+    head.after = 1;
+    head.after_value = last_value;
+    memcpy(&out[pos], &head, sizeof(head));
+}
+
+class Server {
+    static constexpr int read_size = 1 << 16;
+    static constexpr int max_read_round = 16;
+    static constexpr size_t max_out = 16 << 20;//stop reading a client who doesn't read its answers
+    static constexpr int max_range = 1 << 16;
+
+    struct Client {
+        int fd = -1;
+        std::string in;//bytes not parsed yet
+        std::string out;//answers not written yet
+        bool closing = false;//no more requests, close after out is written
+    };
+
+    struct Request {
+        Client *client;
+        RequestHead head;
+        Key lo, hi;
+        std::string answer;
+    };
+
+    //requests of a read run in order of lo
+    struct LoLess {
+        const sjtu::vector<Request> *requests;
+
+        bool operator()(int a, int b) const {
+            return (*requests)[a].lo < (*requests)[b].lo;
+        }
+    };
+
+    BPlusTree<Key, int> *tree;
+    TraceWriter *trace;//inserts, deletes and finds are recorded if given
+    std::string path;
+    int listen_fd = -1;
+    sjtu::vector<Client *> clients;
+    sjtu::vector<Request> requests;//of this round
+    bool stopping = false;
+
+    static volatile std::sig_atomic_t &Interrupted() {
+        static volatile std::sig_atomic_t interrupted = 0;
+        return interrupted;
+    }
+
+    static void OnSignal(int) {
+        Interrupted() = 1;
+    }
+
+public:
+    Server(BPlusTree<Key, int> &tree, const std::string &path, TraceWriter *trace = nullptr) :
+            tree(&tree), trace(trace), path(path) {}
+
+    Server(const Server &) = delete;
+
+    Server &operator=(const Server &) = delete;
+
+    ~Server() {
+        for (size_t i = 0; i < clients.size(); ++i) {
+            close(clients[i]->fd);
+            delete clients[i];
+        }
+        if (listen_fd != -1) {
+            close(listen_fd);
+            unlink(path.c_str());
+        }
+    }
+
+    /*
+     * serve until a stop request, SIGINT or SIGTERM
+     * return false if the socket can't be made
+     */
+    bool Run() {
+        if (!Listen()) return false;
+        signal(SIGINT, OnSignal);
+        signal(SIGTERM, OnSignal);
+        signal(SIGPIPE, SIG_IGN);
+        sjtu::vector<pollfd> fds;
+        while (!stopping && !Interrupted()) {
+            fds.clear();
+            pollfd listen_poll{listen_fd, POLLIN, 0};
+            fds.push_back(listen_poll);
+            for (size_t i = 0; i < clients.size(); ++i) {
+                Client *client = clients[i];
+                short events = 0;
+                if (!client->closing && client->out.size() < max_out) events |= POLLIN;
+                if (!client->out.empty()) events |= POLLOUT;
+                pollfd client_poll{client->fd, events, 0};
+                fds.push_back(client_poll);
+            }
+            if (poll(&fds[0], fds.size(), 1000) < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            for (size_t i = 0; i < clients.size(); ++i) {
+                if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) Receive(*clients[i]);
+            }
+            RunRequests();
+            for (size_t i = 0; i < clients.size(); ++i) Send(*clients[i]);
+            Drop();
+            if (fds[0].revents & POLLIN) Accept();
+        }
+        return true;
+    }
+
+private:
+    bool Listen() {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) return false;
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(path.c_str());//left by a server killed before
+        if (bind(listen_fd, reinterpret_cast<sockaddr *> (&address), sizeof(address)) < 0 ||
+            listen(listen_fd, 64) < 0) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    void Accept() {
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) return;
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            Client *client = new Client;
+            client->fd = fd;
+            clients.push_back(client);
+        }
+    }
+
+    //read what has come, then cut whole requests out of it
+    void Receive(Client &client) {
+        char buffer[read_size];
+        for (int round = 0; round < max_read_round; ++round) {//the others are served in between
+            long got = read(client.fd, buffer, sizeof(buffer));
+            if (got > 0) {
+                client.in.append(buffer, got);
+                if (got < (long) sizeof(buffer)) break;
+                continue;
+            }
+            if (got < 0 && errno == EINTR) continue;
+            if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) client.closing = true;
+            break;
+        }
+        size_t pos = 0;
+        while (client.in.size() - pos >= sizeof(RequestHead)) {
+            RequestHead head;
+            memcpy(&head, client.in.data() + pos, sizeof(head));
+            size_t length = sizeof(head) + head.lo_length + head.hi_length;
+            if (client.in.size() - pos < length) break;
+            if (head.op < request_insert || head.op > request_stop || head.lo_length >= sizeof(Key().index) ||
+                head.hi_length >= sizeof(Key().index)) {//not our protocol
+                client.closing = true;
+                break;
+            }
+            Request request;
+            request.client = &client;
+            request.head = head;
+            char index[sizeof(Key().index)];
+            memcpy(index, client.in.data() + pos + sizeof(head), head.lo_length);
+            index[head.lo_length] = '\0';
+            request.lo = Key(index, head.value);
+            memcpy(index, client.in.data() + pos + sizeof(head) + head.lo_length, head.hi_length);
+            index[head.hi_length] = '\0';
+            request.hi = Key(index);
+            requests.push_back(request);
+            pos += length;
+        }
+        client.in.erase(0, pos);
+    }
+
+    //writes in order, each run of reads in key order
+    void RunRequests() {
+        int n = (int) requests.size();
+        int *order = new int[n];
+        int *tmp = new int[n];
+        int begin = 0;
+        while (begin < n) {
+            int end = begin;
+            while (end < n && IsRead(requests[end])) ++end;
+            if (end == begin) {
+                Answer(requests[begin]);
+                ++begin;
+                continue;
+            }
+            for (int i = begin; i < end; ++i) order[i] = i;
+            sjtu::MergeSort(order, tmp, begin, end, LoLess{&requests});
+            for (int i = begin; i < end; ++i) Answer(requests[order[i]]);
+            begin = end;
+        }
+        delete[] order;
+        delete[] tmp;
+        for (int i = 0; i < n; ++i) requests[i].client->out += requests[i].answer;
+        requests.clear();
+    }
+
+    static bool IsRead(const Request &request) {
+        return request.head.op == request_find || request.head.op == request_range;
+    }
+
+    void Answer(Request &request) {
+        ResponseHead head;
+        head.op = request.head.op;
+        std::string &answer = request.answer;
+        answer.append(sizeof(head), '\0');
+        if (trace && head.op < request_range) {
+            TraceOp op = head.op == request_insert ? trace_insert : head.op == request_delete ? trace_delete : trace_find;
+            trace->Put(op, request.lo.index, head.op == request_find ? 0 : request.head.value);
+        }
+        if (head.op == request_insert) {
+            head.status = tree->Insert(request.lo, request.head.value);
+        } else if (head.op == request_delete) {
+            head.status = tree->Delete(request.lo);
+        } else if (head.op == request_find) {
+            tree->Find(Key(request.lo.index), cmp2(), [&](const Key &, const int &value) {
+                answer.append(reinterpret_cast<const char *> (&value), sizeof(value));
+                ++head.count;
+                return true;
+            });
+            head.status = head.count > 0;
+        } else if (head.op == request_range) {
+            int limit = request.head.value > 0 && request.head.value < max_range ? request.head.value : max_range;
+            sjtu::vector<std::pair<Key, int>> eles;
+            BPlusTree<Key, int>::RangeCursor cursor;
+            if (request.head.after) {
+                cursor.last = Key(request.lo.index, request.head.after_value);
+                cursor.started = true;
+            }
+            tree->Range(Key(request.lo.index), request.hi, cmp2(), limit, eles, cursor);
+            for (size_t i = 0; i < eles.size(); ++i) {
+                unsigned char length = (unsigned char) strlen(eles[i].first.index);
+                answer.push_back((char) length);
+                answer.append(eles[i].first.index, length);
+                answer.append(reinterpret_cast<const char *> (&eles[i].second), sizeof(int));
+            }
+            head.count = (unsigned int) eles.size();
+            head.status = !cursor.done;
+        } else {//stop, after the answers of this round are sent
+            stopping = true;
+        }
+        memcpy(&answer[0], &head, sizeof(head));
+    }
+
+    void Send(Client &client) {
+        size_t done = 0;
+        while (done < client.out.size()) {
+            long written = write(client.fd, client.out.data() + done, client.out.size() - done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {//the client is gone
+                    client.closing = true;
+                    done = client.out.size();
+                }
+                break;
+            }
+            done += written;
+        }
+        client.out.erase(0, done);
+    }
+
+    //close the clients who are done
+    void Drop() {
+        size_t kept = 0;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client *client = clients[i];
+            if (client->closing && client->out.empty()) {
+                close(client->fd);
+                delete client;
+            } else {
+                clients[kept++] = client;
+            }
+        }
+        while (clients.size() > kept) clients.pop_back();
+    }
+};
+
+#endif //TICKETSYSTEM_SERVER_HPP
@@ -0,0 +1,149 @@
+/*
+ * TRACE
+ * the operations on the index of main, recorded to replay them later (see replay.cpp)
+ *
+ * header   magic "BPTT", version
+ * records  op, time since the record before in ns, index length, index, value
+ *          numbers are varints, the value zigzag coded
+ * the end of the file ends the trace, a record cut by a crash is dropped
+ */
+
+#ifndef TICKETSYSTEM_TRACE_HPP
+#define TICKETSYSTEM_TRACE_HPP
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+enum TraceOp {
+    trace_insert = 1, trace_delete, trace_find
+};
+
+struct TraceHeader {
+    char magic[4] = {'B', 'P', 'T', 'T'};
+    unsigned int version = 1;
+};
+
+struct TraceRecord {
+    TraceOp op = trace_find;
+    long long time = 0;//ns since the trace began
+    char index[64];
+    int value = 0;
+};
+
+class TraceWriter {
+    static constexpr size_t buffer_size = 1 << 16;
+
+    std::ofstream file;
+    std::string buffer;
+    std::chrono::steady_clock::time_point begin;
+    long long last_time = 0;
+
+public:
+    explicit TraceWriter(const std::string &file_name) :
+            file(file_name, std::ios::binary | std::ios::trunc), begin(std::chrono::steady_clock::now()) {
+        TraceHeader header;
+        file.write(reinterpret_cast<const char *> (&header), sizeof(header));
+    }
+
+    TraceWriter(const TraceWriter &) = delete;
+
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    ~TraceWriter() {
+        Flush();
+    }
+
+    bool Good() const {
+        return file.good();
+    }
+
+    /*
+     * index longer than TraceRecord::index is cut
+     * time is ns since the trace began, now if it is -1 (e.g. a generated trace gives its own)
+     */
+    void Put(TraceOp op, const char *index, int value, long long time = -1) {
+        if (time < 0) {
+            time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+        }
+        if (time < last_time) time = last_time;
+        size_t length = strlen(index);
+        if (length >= sizeof(TraceRecord().index)) length = sizeof(TraceRecord().index) - 1;
+        buffer.push_back((char) op);
+        PutNumber((unsigned long long) (time - last_time));
+        buffer.push_back((char) length);
+        buffer.append(index, length);
+        PutNumber(((unsigned long long) value << 1) ^ (unsigned long long) (value >> 31));
+        last_time = time;
+        if (buffer.size() >= buffer_size) Flush();
+    }
+
+    void Flush() {
+        file.write(buffer.data(), (std::streamsize) buffer.size());
+        file.flush();
+        buffer.clear();
+    }
+
+private:
+    void PutNumber(unsigned long long number) {
+        while (number >= 0x80) {
+            buffer.push_back((char) ((number & 0x7f) | 0x80));
+            number >>= 7;
+        }
+        buffer.push_back((char) number);
+    }
+};
+
+class TraceReader {
+    std::ifstream file;
+    long long time = 0;
+    bool good = true;
+
+public:
+    //Good is false if the file is not a trace
+    explicit TraceReader(const std::string &file_name) : file(file_name, std::ios::binary) {
+        TraceHeader header, expect;
+        file.read(reinterpret_cast<char *> (&header), sizeof(header));
+        good = file.good() && !memcmp(header.magic, expect.magic, sizeof(header.magic)) &&
+               header.version == expect.version;
+    }
+
+    bool Good() const {
+        return good;
+    }
+
+    //the next record, false at the end
+    bool Next(TraceRecord &record) {
+        if (!good) return false;
+        int op = file.get();
+        if (op < trace_insert || op > trace_find) return false;
+        unsigned long long delta, value;
+        if (!GetNumber(delta)) return false;
+        int length = file.get();
+        if (length < 0 || length >= (int) sizeof(record.index)) return false;
+        file.read(record.index, length);
+        if (!file.good() || !GetNumber(value)) return false;
+        record.index[length] = '\0';
+        record.op = (TraceOp) op;
+        time += (long long) delta;
+        record.time = time;
+        record.value = (int) ((value >> 1) ^ (~(value & 1) + 1));
+        return true;
+    }
+
+private:
+    bool GetNumber(unsigned long long &number) {
+        number = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = file.get();
+            if (byte < 0) return false;
+            number |= (unsigned long long) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+};
+
+#endif //TICKETSYSTEM_TRACE_HPP
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <climits>
 #include <cstddef>
+#include <new>
+#include <utility>
 #include "file_manager.hpp"
 
 //size_t 无符号整数，做数组下标
@@ -18,20 +20,30 @@ namespace sjtu {
     template<typename T>
     class vector {
     private:
-        T **storage = nullptr;//指针数组的数组名
+        T *storage = nullptr;//连续空间的首地址
 
-        size_t size_of_vector = 0;//数组大小
+        size_t size_of_vector = 0;//容量
 
         size_t end_of_vector = 0;//数组最后一个元素的下一位下标
 
-        //在vector的storage开新的指针数组，原来的 指针数组暂归在tmp下
-        //修改
-        T **doubleSpace();//扩容函数
+        //换到一块容量为capacity的新空间，原有元素move过去
+        void reallocate(size_t capacity);
 
-        //从数组的begin项开始到end项结束[begin,end)
-        //storage接管tmp指向的空间
-        //错位为step
-        void copyDate(T **tmp, size_t begin, size_t end, int step = 0);
+        //至少能放下need个元素，按两倍增长
+        void grow(size_t need) {
+            if (need <= size_of_vector) return;
+            size_t capacity = size_of_vector ? size_of_vector * 2 : 1;
+            if (capacity < need) capacity = need;
+            reallocate(capacity);
+        }
+
+        //[begin,end)的元素析构
+        void destroy(size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) storage[i].~T();
+        }
+
+        //给第index位腾出位置，返回插入位置
+        T *makeRoom(size_t index);
 
         int Random(int l, int r) {
             srand(time(NULL));
@@ -106,8 +118,8 @@ namespace sjtu {
             }
 
             iterator operator-(const int &n) const {
-                vector<T>::iterator tmp(this);
-                tmp.index += n;
+                vector<T>::iterator tmp(this->index, this->vector_location);
+                tmp.index -= n;
                 return tmp;
             }
 
@@ -131,7 +143,7 @@ namespace sjtu {
              *  iter++
              */
             iterator operator++(int) {
-                vector<T>::iterator tmp(this);
+                vector<T>::iterator tmp(this->index, this->vector_location);
                 ++this->index;
                 return tmp;
             }
@@ -148,7 +160,7 @@ namespace sjtu {
              *  iter--
              */
             iterator operator--(int) {
-                vector<T>::iterator tmp(this);
+                vector<T>::iterator tmp(this->index, this->vector_location);
                 --this->index;
                 return tmp;
             }
@@ -166,7 +178,7 @@ namespace sjtu {
              * 解引用
              */
             T &operator*() const {
-                return *vector_location->storage[index];
+                return vector_location->storage[index];
             }
 
             /**
@@ -227,14 +239,14 @@ namespace sjtu {
             }
 
             const_iterator operator+(const int &n) const {
-                vector<T>::const_iterator tmp(this);
+                vector<T>::const_iterator tmp(this->index, this->vector_location);
                 tmp.index += n;
                 return tmp;
             }
 
             const_iterator operator-(const int &n) const {
-                vector<T>::const_iterator tmp(this);
-                tmp.index += n;
+                vector<T>::const_iterator tmp(this->index, this->vector_location);
+                tmp.index -= n;
                 return tmp;
             }
 
@@ -258,7 +270,7 @@ namespace sjtu {
              *  iter++
              */
             const_iterator operator++(int) {
-                vector<T>::const_iterator tmp(this);
+                vector<T>::const_iterator tmp(this->index, this->vector_location);
                 ++this->index;
                 return tmp;
             }
@@ -275,7 +287,7 @@ namespace sjtu {
              *  iter--
              */
             const_iterator operator--(int) {
-                vector<T>::const_iterator tmp(this);
+                vector<T>::const_iterator tmp(this->index, this->vector_location);
                 --this->index;
                 return tmp;
             }
@@ -293,7 +305,7 @@ namespace sjtu {
              * 解引用
              */
             const T &operator*() const {
-                return *vector_location->storage[index];
+                return vector_location->storage[index];
             }
 
             /**
@@ -328,6 +340,7 @@ namespace sjtu {
 
         };
 
+
         /**
          *  Constructs
          * At least two: default constructor, copy constructor
@@ -336,6 +349,13 @@ namespace sjtu {
 
         vector(const vector &other);
 
+        //接管other的空间
+        vector(vector &&other) noexcept: storage(other.storage), size_of_vector(other.size_of_vector),
+                                         end_of_vector(other.end_of_vector) {
+            other.storage = nullptr;
+            other.size_of_vector = other.end_of_vector = 0;
+        }
+
         /**
          *  Destructor
          */
@@ -346,22 +366,29 @@ namespace sjtu {
          * 赋值重载
          * 自己赋给自己？
          * 删掉原有
-         * new新的
+         * 空间够用就直接在原空间上拷贝构造
          */
         vector &operator=(const vector &other) {
             if (this == &other)return *this;
-            //删
-            for (int i = 0; i < end_of_vector; ++i) {
-                delete storage[i];
+            destroy(0, end_of_vector);
+            end_of_vector = 0;
+            if (size_of_vector < other.end_of_vector) reallocate(other.end_of_vector);
+            for (size_t i = 0; i < other.end_of_vector; ++i) {
+                new(storage + i) T(other.storage[i]);//直接调用拷贝构造
             }
-            delete[] storage;
-            //新建
+            end_of_vector = other.end_of_vector;
+            return *this;
+        }
+
+        vector &operator=(vector &&other) noexcept {
+            if (this == &other)return *this;
+            destroy(0, end_of_vector);
+            ::operator delete(storage);
+            storage = other.storage;
             size_of_vector = other.size_of_vector;
             end_of_vector = other.end_of_vector;
-            storage = new T *[size_of_vector];//新的指针数组
-            for (size_t i = 0; i < end_of_vector; ++i) {
-                storage[i] = new T(*other.storage[i]);//直接调用拷贝构造
-            }
+            other.storage = nullptr;
+            other.size_of_vector = other.end_of_vector = 0;
             return *this;
         }
 
@@ -371,11 +398,11 @@ namespace sjtu {
          * 检查下标越界的赋值
          */
         T &at(const size_t &pos) {
-            return *storage[pos];
+            return storage[pos];
         }
 
         const T &at(const size_t &pos) const {
-            return *storage[pos];
+            return storage[pos];
         }
 
         /**
@@ -385,11 +412,11 @@ namespace sjtu {
          *   In STL this operator does not check the boundary but I want you to do.
          */
         T &operator[](const size_t &pos) {
-            return *storage[pos];
+            return storage[pos];
         }
 
         const T &operator[](const size_t &pos) const {
-            return *storage[pos];
+            return storage[pos];
         }
 
         /**
@@ -397,7 +424,7 @@ namespace sjtu {
          * throw container_is_empty if size == 0
          */
         const T &front() const {
-            return *storage[0];
+            return storage[0];
         }
 
         /**
@@ -405,7 +432,7 @@ namespace sjtu {
          * throw container_is_empty if size == 0
          */
         const T &back() const {
-            return *storage[end_of_vector - 1];
+            return storage[end_of_vector - 1];
         }
 
         /**
@@ -446,15 +473,27 @@ namespace sjtu {
             return end_of_vector;
         }
 
+        /**
+         * returns the number of elements that can be held without allocation
+         */
+        size_t capacity() const {
+            return size_of_vector;
+        }
+
+        /**
+         * make sure n elements can be held without another allocation
+         * grow geometrically, so reserving size()+k again and again stays amortized O(1)
+         */
+        void reserve(size_t n) {
+            grow(n);
+        }
+
         /**
          * clears the contents
+         * keep the space for later push_back
          */
         void clear() {
-            for (int i = 0; i < end_of_vector; ++i) {
-                delete storage[i];
-            }
-            delete[] storage;
-            size_of_vector = 0;
+            destroy(0, end_of_vector);
             end_of_vector = 0;
         }
 
@@ -463,7 +502,7 @@ namespace sjtu {
             if (!end_of_vector)return false;
             int iter = 0;
             while (iter < end_of_vector) {
-                std::cout << *storage[iter] << ' ';
+                std::cout << storage[iter] << ' ';
                 ++iter;
             }
             return true;
@@ -474,23 +513,7 @@ namespace sjtu {
          * pos合法吗
          */
         iterator insert(iterator pos, const T &value) {
-            size_t index = pos.index;//待插入的下标
-            if (end_of_vector == size_of_vector) {//拓展空间
-                T **tmp = doubleSpace();//在vector的storage开新的指针数组，原来的 指针数组暂归在tmp下
-                copyDate(tmp, 0, index);//0- (index-1)直接接管
-                storage[index] = new T(value);//插入
-                copyDate(tmp, index, end_of_vector, 1);//错位接管
-                delete[] tmp;//删旧指针数组
-            } else {
-                size_t current_index = end_of_vector;
-                while (current_index > index) {
-                    storage[current_index] = storage[current_index - 1];
-                    --current_index;
-                }
-                storage[index] = new T(value);
-            }
-            ++end_of_vector;
-            return pos;
+            return insert(pos.index, value);
         }
 
         /**
@@ -500,20 +523,10 @@ namespace sjtu {
          * throw index_out_of_bound if ind > size (in this situation ind can be size because after inserting the size will increase 1.)
          */
         iterator insert(const size_t &ind, const T &value) {
-            if (end_of_vector == size_of_vector) {//拓展空间
-                T **tmp = doubleSpace();//在vector的storage开新的指针数组，原来的 指针数组暂归在tmp下
-                copyDate(tmp, 0, ind - 1);//0- (index-1)直接接管
-                storage[ind] = new T(value);//插入
-                copyDate(tmp, ind, end_of_vector - 1, 1);//错位接管
-                delete[] tmp;//删旧指针数组
-            } else {
-                size_t current_index = end_of_vector;
-                while (current_index > ind) {
-                    storage[current_index] = storage[current_index - 1];
-                    --current_index;
-                }
-                storage(ind) = new T(value);
-            }
+            if (&value >= storage && &value < storage + end_of_vector) {
+                T copy(value);//value在原空间里，移动前先拷出来
+                new(makeRoom(ind)) T(std::move(copy));
+            } else new(makeRoom(ind)) T(value);
             ++end_of_vector;
             return iterator(ind, this);
         }
@@ -524,14 +537,7 @@ namespace sjtu {
          * If the iterator pos refers the last element, the end() iterator is returned.
          */
         iterator erase(iterator pos) {
-            size_t index = pos.index;
-            --end_of_vector;
-            T *tmp = storage[index];
-            while (index < end_of_vector) {
-                storage[index] = storage[index + 1];
-                ++index;
-            }
-            delete tmp;
+            erase(pos.index);
             return pos;
         }
 
@@ -542,13 +548,10 @@ namespace sjtu {
          */
         iterator erase(const size_t &ind) {
             --end_of_vector;
-            size_t index = ind;
-            T *tmp = storage[index];
-            while (index < end_of_vector) {
-                storage[index] = storage[1 + index];
-                ++index;
+            for (size_t index = ind; index < end_of_vector; ++index) {
+                storage[index] = std::move(storage[index + 1]);
             }
-            delete tmp;
+            storage[end_of_vector].~T();
             return iterator(ind, this);
         }
 
@@ -557,69 +560,99 @@ namespace sjtu {
          */
         void push_back(const T &value) {
             if (end_of_vector == size_of_vector) {
-                T **tmp = doubleSpace();
-                copyDate(tmp, 0, end_of_vector);
-                if (end_of_vector)delete[] tmp;
-            }
-            storage[end_of_vector] = new T(value);
+                T copy(value);//value可能在原空间里
+                grow(end_of_vector + 1);
+                new(storage + end_of_vector) T(std::move(copy));
+            } else new(storage + end_of_vector) T(value);
             ++end_of_vector;
         }
 
+        void push_back(T &&value) {
+            emplace_back(std::move(value));
+        }
+
+        /**
+         * constructs an element at the end in place
+         */
+        template<class... Args>
+        T &emplace_back(Args &&... args) {
+            if (end_of_vector == size_of_vector) {
+                //先在新空间里构造，参数可能引用原空间里的元素
+                size_t capacity = size_of_vector ? size_of_vector * 2 : 1;
+                T *tmp = static_cast<T *>(::operator new(capacity * sizeof(T)));
+                new(tmp + end_of_vector) T(std::forward<Args>(args)...);
+                for (size_t i = 0; i < end_of_vector; ++i) {
+                    new(tmp + i) T(std::move(storage[i]));
+                    storage[i].~T();
+                }
+                ::operator delete(storage);
+                storage = tmp;
+                size_of_vector = capacity;
+            } else new(storage + end_of_vector) T(std::forward<Args>(args)...);
+            return storage[end_of_vector++];
+        }
+
         /**
          * remove the last element from the end.
          * throw container_is_empty if size() == 0
          */
         void pop_back() {
             --end_of_vector;
-            delete storage[end_of_vector];
+            storage[end_of_vector].~T();
         }
     };
 
     //拷贝构造函数
+    //一次分配恰好够用的空间
     template<typename T>
     vector<T>::vector(const vector &other) {
-        size_of_vector = other.size_of_vector;
-        end_of_vector = other.end_of_vector;
-        storage = new T *[size_of_vector];//新的指针数组
-        for (size_t i = 0; i < end_of_vector; ++i) {
-            storage[i] = new T(*other.storage[i]);//直接调用赋值构造
+        if (!other.end_of_vector) return;
+        storage = static_cast<T *>(::operator new(other.end_of_vector * sizeof(T)));
+        size_of_vector = other.end_of_vector;
+        for (size_t i = 0; i < other.end_of_vector; ++i) {
+            new(storage + i) T(other.storage[i]);//直接调用拷贝构造
         }
+        end_of_vector = other.end_of_vector;
     }
 
     //析构函数
-    //先析构指针数组指向的对象
-    //析构指针数组
+    //先析构元素
+    //再释放空间
     template<typename T>
     vector<T>::~vector() {
-        for (int i = 0; i < end_of_vector; ++i) {
-            delete storage[i];
-        }
-        delete[] storage;
+        destroy(0, end_of_vector);
+        ::operator delete(storage);
     }
 
     template<typename T>
-    T **vector<T>::doubleSpace() {
-        T **tmp = storage;
-        if (!size_of_vector) size_of_vector = 1;
-        size_of_vector *= 2;
-        storage = new T *[size_of_vector];
-        return tmp;
+    void vector<T>::reallocate(size_t capacity) {
+        T *tmp = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0; i < end_of_vector; ++i) {
+            new(tmp + i) T(std::move(storage[i]));
+            storage[i].~T();
+        }
+        ::operator delete(storage);
+        storage = tmp;
+        size_of_vector = capacity;
     }
 
-    //从数组的begin项开始到end项结束
-    //storage接管tmp指向的空间
-    //错位为step
+    //[index,end)整体后移一位，index处留下未构造的空间
     template<typename T>
-    void vector<T>::copyDate(T **tmp, size_t begin, size_t end, int step) {
-        for (size_t current_index = begin; current_index < end; ++current_index) {
-            storage[current_index + step] = tmp[current_index];
+    T *vector<T>::makeRoom(size_t index) {
+        grow(end_of_vector + 1);
+        if (index == end_of_vector) return storage + index;
+        new(storage + end_of_vector) T(std::move(storage[end_of_vector - 1]));
+        for (size_t i = end_of_vector - 1; i > index; --i) {
+            storage[i] = std::move(storage[i - 1]);
         }
+        storage[index].~T();
+        return storage + index;
     }
 
     template<class T>
     void bubSort(vector<T> &vec, int l, int r, bool (*cmp)(T, T)) {
         for (int i = l + 1; i <= r; ++i) {
-            for (int j = i; j > 0 && cmp(*vec.storage[j], *vec.storage[j - 1]); j--)
+            for (int j = i; j > 0 && cmp(vec.storage[j], vec.storage[j - 1]); j--)
                 std::swap(vec.storage[j], vec.storage[j - 1]);
         }
     }
@@ -632,21 +665,21 @@ namespace sjtu {
             return;
         }
         std::swap(vec.storage[vec.Random(l, r)], vec.storage[l]);
-        T *tmp = vec.storage[l];
+        T tmp = std::move(vec.storage[l]);
         int left = l, right = r;
         do {
-            while (cmp(*tmp, *vec.storage[r]) && l < r) --r;
+            while (cmp(tmp, vec.storage[r]) && l < r) --r;
             if (l < r) {
-                vec.storage[l] = vec.storage[r];
+                vec.storage[l] = std::move(vec.storage[r]);
                 ++l;
             }
-            while (cmp(*vec.storage[l], *tmp) && l < r) ++l;
+            while (cmp(vec.storage[l], tmp) && l < r) ++l;
             if (l < r) {
-                vec.storage[r] = vec.storage[l];
+                vec.storage[r] = std::move(vec.storage[l]);
                 --r;
             }
         } while (l < r);
-        vec.storage[l] = tmp;
+        vec.storage[l] = std::move(tmp);
         Sort(vec, left, l - 1, cmp);
         Sort(vec, l + 1, right, cmp);
     }
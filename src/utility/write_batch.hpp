@@ -0,0 +1,228 @@
+/*
+ * WRITE_BATCH
+ * Insert, Delete and Update on one or more trees, applied all or nothing by Commit
+ *
+ * an op fails if Insert finds its key, or Delete or Update doesn't,
+ * then the ops applied are undone in reverse order and Commit returns false;
+ * an exception thrown by a tree is handled the same way, then thrown again
+ * (if undoing throws as well, the journal is left: close the trees and Recover)
+ *
+ * ops are applied tree by tree in key order (ops on one key keep their order),
+ * so the ops on a block follow each other while it is cached and it is written back once
+ *
+ * a crash while applying is undone too: Commit flushes the trees, then keeps every byte it overwrites
+ * in a journal (see journal.hpp) until the trees are flushed again and the commit record is written,
+ * a journal left by a crash is undone by Recover, which must be called before the trees are opened
+ */
+
+#ifndef TICKETSYSTEM_WRITE_BATCH_HPP
+#define TICKETSYSTEM_WRITE_BATCH_HPP
+
+#include <exception>
+#include <string>
+#include "BPlusTree.hpp"
+#include "exception.hpp"
+#include "journal.hpp"
+#include "parallel_sort.hpp"
+#include "vector.hpp"
+
+class WriteBatch {
+    enum OpType {
+        op_insert, op_delete, op_update
+    };
+
+    //what Commit needs to know about an op, whatever the types of its tree
+    struct Op {
+        int tree_index;//trees are numbered in the order they first appear in the batch
+        bool applied = false;
+
+        explicit Op(int tree_index) : tree_index(tree_index) {}
+
+        virtual ~Op() = default;
+
+        //key order, only asked for ops on the same tree
+        virtual bool KeyBefore(const Op &other) const = 0;
+
+        virtual bool Apply() = 0;
+
+        virtual void Undo() = 0;
+
+        //of the tree of the op
+        virtual void Flush() = 0;
+
+        virtual void SetJournal(Journal *journal) = 0;
+    };
+
+    template<class Key, class Value>
+    struct TreeOp : public Op {
+        BPlusTree<Key, Value> *tree;
+        OpType type;
+        Key key;
+        Value value;
+        Value old;//value before Delete or Update
+
+        TreeOp(int tree_index, BPlusTree<Key, Value> *tree, OpType type, const Key &key, const Value &value) :
+                Op(tree_index), tree(tree), type(type), key(key), value(value) {}
+
+        bool KeyBefore(const Op &other) const override {
+            return key < static_cast<const TreeOp &> (other).key;
+        }
+
+        bool Apply() override {
+            if (type == op_insert) applied = tree->Insert(key, value);
+            else if (type == op_update) applied = tree->Update(key, value, &old);
+            else applied = tree->Get(key, old) && tree->Delete(key);
+            return applied;
+        }
+
+        void Undo() override {
+            if (!applied) return;
+            if (type == op_insert) tree->Delete(key);
+            else if (type == op_update) tree->Update(key, old);
+            else tree->Insert(key, old);
+            applied = false;
+        }
+
+        void Flush() override {
+            tree->Flush();
+        }
+
+        void SetJournal(Journal *journal) override {
+            tree->SetJournal(journal);
+        }
+    };
+
+    struct ApplyOrder {
+        bool operator()(const Op *a, const Op *b) const {
+            if (a->tree_index != b->tree_index) return a->tree_index < b->tree_index;
+            return a->KeyBefore(*b);
+        }
+    };
+
+    std::string journal_name;
+    sjtu::vector<Op *> ops;
+    sjtu::vector<const void *> trees;
+
+public:
+    //the journal of Commit is written at journal_name, the same name is passed to Recover
+    explicit WriteBatch(const std::string &journal_name) : journal_name(journal_name) {}
+
+    WriteBatch(const WriteBatch &) = delete;
+
+    WriteBatch &operator=(const WriteBatch &) = delete;
+
+    ~WriteBatch() {
+        Clear();
+    }
+
+    template<class Key, class Value>
+    void Insert(BPlusTree<Key, Value> &tree, const Key &key, const Value &value) {
+        Add(tree, op_insert, key, value);
+    }
+
+    template<class Key, class Value>
+    void Delete(BPlusTree<Key, Value> &tree, const Key &key) {
+        Add(tree, op_delete, key, Value());
+    }
+
+    template<class Key, class Value>
+    void Update(BPlusTree<Key, Value> &tree, const Key &key, const Value &value) {
+        Add(tree, op_update, key, value);
+    }
+
+    long Size() const {
+        return (long) ops.size();
+    }
+
+    //drop the ops, the batch may be filled again
+    void Clear() {
+        for (size_t i = 0; i < ops.size(); ++i) delete ops[i];
+        ops.clear();
+        trees.clear();
+    }
+
+    /*
+     * apply every op, or none of them and return false; the batch is empty after
+     * the trees are flushed when it returns, a crash before is undone by Recover
+     * throw sjtu::runtime_error if the journal can't be written
+     */
+    bool Commit() {
+        long n = (long) ops.size();
+        Op **order = new Op *[n];
+        for (long i = 0; i < n; ++i) order[i] = ops[i];
+        Op **tmp = new Op *[n];
+        sjtu::MergeSort(order, tmp, 0, n, ApplyOrder());
+        delete[] tmp;
+        Journal journal(journal_name);
+        if (!journal.Good()) {
+            delete[] order;
+            Clear();
+            throw sjtu::runtime_error();
+        }
+        //the files hold the trees as they are before the batch, then what is overwritten is kept
+        FlushTrees(order, n);
+        SetJournal(order, n, &journal);
+        long done = 0;
+        bool success = true;
+        std::exception_ptr error;
+        try {
+            while (done < n && order[done]->Apply()) ++done;
+            success = done == n;
+        } catch (...) {
+            error = std::current_exception();
+        }
+        try {
+            if (error || !success) Rollback(order, done);
+            FlushTrees(order, n);
+            journal.Commit();
+        } catch (...) {//the journal is left for Recover
+            if (!error) error = std::current_exception();
+        }
+        SetJournal(order, n, nullptr);
+        delete[] order;
+        Clear();
+        if (error) std::rethrow_exception(error);
+        return success;
+    }
+
+    /*
+     * undo a batch cut by a crash, whose journal was written at journal_name, see Journal::Recover
+     * call it before the trees are opened, return true if a batch is undone
+     */
+    static bool Recover(const std::string &journal_name) {
+        return Journal::Recover(journal_name);
+    }
+
+private:
+    template<class Key, class Value>
+    void Add(BPlusTree<Key, Value> &tree, OpType type, const Key &key, const Value &value) {
+        int tree_index = 0;
+        while (tree_index < (int) trees.size() && trees[tree_index] != &tree) ++tree_index;
+        if (tree_index == (int) trees.size()) trees.push_back(&tree);
+        ops.push_back(new TreeOp<Key, Value>(tree_index, &tree, type, key, value));
+    }
+
+    //undo order[0,done) from the last one
+    void Rollback(Op **order, long done) {
+        for (long i = done - 1; i >= 0; --i) order[i]->Undo();
+    }
+
+    //ops of a tree follow each other in order
+    static bool FirstOfTree(Op **order, long i) {
+        return !i || order[i]->tree_index != order[i - 1]->tree_index;
+    }
+
+    void FlushTrees(Op **order, long n) {
+        for (long i = 0; i < n; ++i) {
+            if (FirstOfTree(order, i)) order[i]->Flush();
+        }
+    }
+
+    void SetJournal(Op **order, long n, Journal *journal) {
+        for (long i = 0; i < n; ++i) {
+            if (FirstOfTree(order, i)) order[i]->SetJournal(journal);
+        }
+    }
+};
+
+#endif //TICKETSYSTEM_WRITE_BATCH_HPP
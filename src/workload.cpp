@@ -0,0 +1,190 @@
+/*
+ * generate commands for code, or a trace for replay
+ *   workload [--option value]...
+ *   --ops n              commands (default 100000)
+ *   --indexes n          distinct indexes (default 10000)
+ *   --values n           values of an index are in [0,n), the most eles find returns (default 16)
+ *   --key-min/--key-max  length of an index, uniform in [min,max] (default 8 and 24)
+ *   --zipf s             skew of the index used, 0 is uniform (default 0)
+ *   --mix i:d:f          weights of insert, delete and find (default 50:20:30)
+ *   --order o            random, or sequential: inserts come in key order (default random)
+ *   --seed n             equal seeds give equal outputs (default 1)
+ *   --trace file         write a trace for replay instead of commands to stdout
+ *   --rate n             commands per second, times of the trace (default 100000)
+ *
+ * an index is its number in fixed width base 36 then letters up to its length,
+ * so indexes sort as their numbers; the zipf rank of an index is scattered over the numbers
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "utility/fast_io.hpp"
+#include "utility/trace.hpp"
+
+using namespace std;
+
+struct Options {
+    long ops = 100000;
+    long indexes = 10000;
+    int values = 16;
+    int key_min = 8, key_max = 24;
+    double zipf = 0;
+    double mix[3] = {50, 20, 30};
+    bool sequential = false;
+    unsigned seed = 1;
+    const char *trace = nullptr;
+    double rate = 100000;
+};
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *name = argv[i], *value = argv[i + 1];
+        if (!strcmp(name, "--ops")) options.ops = atol(value);
+        else if (!strcmp(name, "--indexes")) options.indexes = atol(value);
+        else if (!strcmp(name, "--values")) options.values = atoi(value);
+        else if (!strcmp(name, "--key-min")) options.key_min = atoi(value);
+        else if (!strcmp(name, "--key-max")) options.key_max = atoi(value);
+        else if (!strcmp(name, "--zipf")) options.zipf = atof(value);
+        else if (!strcmp(name, "--mix")) {
+            if (sscanf(value, "%lf:%lf:%lf", &options.mix[0], &options.mix[1], &options.mix[2]) != 3) return false;
+        } else if (!strcmp(name, "--order")) options.sequential = !strcmp(value, "sequential");
+        else if (!strcmp(name, "--seed")) options.seed = (unsigned) atol(value);
+        else if (!strcmp(name, "--trace")) options.trace = value;
+        else if (!strcmp(name, "--rate")) options.rate = atof(value);
+        else return false;
+    }
+    if (argc % 2 == 0) return false;//an option without value
+    if (options.key_max > 63) options.key_max = 63;//length of Key::index
+    if (options.key_min > options.key_max) options.key_min = options.key_max;
+    return options.ops >= 0 && options.indexes > 0 && options.values > 0 && options.rate > 0 &&
+           options.mix[0] >= 0 && options.mix[1] >= 0 && options.mix[2] >= 0 &&
+           options.mix[0] + options.mix[1] + options.mix[2] > 0;
+}
+
+//the name of index number id
+class IndexNames {
+    long indexes;
+    int width = 1;//base 36 digits of the largest number
+    int key_min, key_max;
+
+public:
+    IndexNames(const Options &options) : indexes(options.indexes), key_min(options.key_min),
+                                         key_max(options.key_max) {
+        for (long n = indexes - 1; n >= 36; n /= 36) ++width;
+    }
+
+    void Name(long id, char *name) const {
+        unsigned long long hash = (unsigned long long) id * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL;
+        int length = key_min + (int) (hash % (unsigned long long) (key_max - key_min + 1));
+        if (length < width) length = width;
+        for (int i = width - 1; i >= 0; --i, id /= 36) name[i] = "0123456789abcdefghijklmnopqrstuvwxyz"[id % 36];
+        for (int i = width; i < length; ++i) {
+            hash ^= hash >> 29;
+            hash *= 0xbf58476d1ce4e5b9ULL;
+            name[i] = (char) ('a' + (hash >> 59) % 26);
+        }
+        name[length] = '\0';
+    }
+};
+
+//index numbers drawn by zipf rank, rank r has weight 1/(r+1)^s
+class IndexChooser {
+    long indexes;
+    double *cumulative = nullptr;//of weights, only when skewed
+    long scatter = 1;//rank r is number r*scatter mod indexes
+
+public:
+    IndexChooser(const Options &options) : indexes(options.indexes) {
+        if (options.zipf > 0) {
+            cumulative = new double[indexes];
+            double total = 0;
+            for (long r = 0; r < indexes; ++r) {
+                total += 1 / pow((double) (r + 1), options.zipf);
+                cumulative[r] = total;
+            }
+        }
+        scatter = (long) (2654435761ULL % (unsigned long long) indexes);
+        while (Gcd(scatter, indexes) != 1) ++scatter;
+    }
+
+    IndexChooser(const IndexChooser &) = delete;
+
+    IndexChooser &operator=(const IndexChooser &) = delete;
+
+    ~IndexChooser() {
+        delete[] cumulative;
+    }
+
+    long Choose(mt19937_64 &random) const {
+        if (!cumulative) return (long) (random() % (unsigned long long) indexes);
+        double target = uniform_real_distribution<double>(0, cumulative[indexes - 1])(random);
+        long l = 0, r = indexes - 1;
+        while (l < r) {
+            long mid = (l + r) >> 1;
+            if (cumulative[mid] < target) l = mid + 1;
+            else r = mid;
+        }
+        return (long) ((unsigned long long) l * (unsigned long long) scatter % (unsigned long long) indexes);
+    }
+
+private:
+    static long Gcd(long a, long b) {
+        while (b) {
+            long t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+};
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: workload [--ops n] [--indexes n] [--values n] [--key-min n] [--key-max n] "
+                        "[--zipf s] [--mix i:d:f] [--order random|sequential] [--seed n] [--trace file] [--rate n]\n");
+        return 1;
+    }
+    IndexNames names(options);
+    IndexChooser chooser(options);
+    mt19937_64 random(options.seed);
+    discrete_distribution<int> mix(options.mix, options.mix + 3);
+    TraceWriter *trace = options.trace ? new TraceWriter(options.trace) : nullptr;
+    FastOutput output;
+    if (!trace) {
+        output.Number(options.ops);
+        output.Put('\n');
+    }
+    long inserted = 0;//inserts so far, the next sequential ele
+    char name[64];
+    for (long i = 0; i < options.ops; ++i) {
+        int op = mix(random);
+        long id;
+        int value;
+        if (op == 0 && options.sequential) {//every value of an index, then the next index
+            id = inserted / options.values % options.indexes;
+            value = (int) (inserted % options.values);
+        } else {
+            id = chooser.Choose(random);
+            value = (int) (random() % (unsigned long long) options.values);
+        }
+        if (op == 0) ++inserted;
+        names.Name(id, name);
+        if (trace) {
+            TraceOp trace_op = op == 0 ? trace_insert : op == 1 ? trace_delete : trace_find;
+            trace->Put(trace_op, name, op == 2 ? 0 : value, (long long) ((double) i * 1e9 / options.rate));
+            continue;
+        }
+        output.Put(op == 0 ? "insert " : op == 1 ? "delete " : "find ");
+        output.Put(name);
+        if (op != 2) {
+            output.Put(' ');
+            output.Number(value);
+        }
+        output.Put('\n');
+    }
+    delete trace;
+    return 0;
+}
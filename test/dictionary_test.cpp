@@ -0,0 +1,113 @@
+/*
+ * strings (some longer than an index holds) are interned, then found again with the same ids
+ * after the table is rebuilt, the dictionary is reopened, and its table is lost and rebuilt from the strings
+ * a BPlusTree<IdKey, int> on the ids is written, reopened and read back by id
+ */
+#include <cstdio>
+#include <string>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+#include "utility/dictionary.hpp"
+
+using namespace std;
+
+const char *dictionary_name = "dictionary_test_dictionary";
+const char *tree_name = "dictionary_test_tree";
+const char *list_name = "dictionary_test_list";
+const int string_num = 3000;//the table of 1024 slots is rebuilt on the way
+const int value_num = 5;
+
+//every third string is longer than an index, those with the same head are one string
+string Name(int i) {
+    char head[32];
+    sprintf(head, "s%05d-", i);
+    if (i % 3) return head;
+    return head + string(100, 'x') + to_string(i);
+}
+
+void RemoveFiles() {
+    remove(dictionary_name);
+    remove((string(dictionary_name) + ".hash").c_str());
+    remove(tree_name);
+    remove(list_name);
+}
+
+//ids must be the ones given first, return the number of errors
+int CheckIds(Dictionary &dictionary, const unsigned int *ids, const char *when) {
+    int failed = 0;
+    if (dictionary.Size() != string_num) {
+        printf("%s: %u strings (want %d)\n", when, dictionary.Size(), string_num);
+        ++failed;
+    }
+    for (int i = 0; i < string_num && !failed; ++i) {
+        string name = Name(i);
+        if (dictionary.Find(name.c_str()) != ids[i] || dictionary.Intern(name.c_str()) != ids[i]) {
+            printf("%s: string %d got another id\n", when, i);
+            ++failed;
+        }
+        char index[Dictionary::index_length];
+        if (!dictionary.GetIndex(ids[i], index) || name.compare(0, Dictionary::index_length - 1, index)) {
+            printf("%s: string of id %u is %s\n", when, ids[i], index);
+            ++failed;
+        }
+    }
+    if (dictionary.Size() != string_num) {
+        printf("%s: a string was interned again\n", when);
+        ++failed;
+    }
+    return failed;
+}
+
+int main() {
+    RemoveFiles();
+    int failed = 0;
+    unsigned int *ids = new unsigned int[string_num];
+    {
+        Dictionary dictionary(dictionary_name);
+        BPlusTree<IdKey, int> tree(tree_name, list_name);
+        for (int i = 0; i < string_num; ++i) {
+            ids[i] = dictionary.Intern(Name(i).c_str());
+            for (int j = 0; j < value_num; ++j) tree.Insert(IdKey(ids[i], j), i * value_num + j);
+        }
+        //the same head with another tail is the same string
+        string other = Name(0).substr(0, Dictionary::index_length - 1) + "tail";
+        if (dictionary.Intern(other.c_str()) != ids[0]) {
+            printf("a long string with the same head got a new id\n");
+            ++failed;
+        }
+        failed += CheckIds(dictionary, ids, "rebuilt");
+    }
+    {
+        Dictionary dictionary(dictionary_name);
+        failed += CheckIds(dictionary, ids, "reopened");
+    }
+    remove((string(dictionary_name) + ".hash").c_str());
+    {
+        Dictionary dictionary(dictionary_name);
+        failed += CheckIds(dictionary, ids, "table lost");
+        BPlusTree<IdKey, int> tree(tree_name, list_name);
+        for (int i = 0; i < string_num; ++i) {
+            long id = dictionary.Find(Name(i).c_str());
+            sjtu::vector<int> values;
+            tree.Find(IdKey((unsigned int) id), id_cmp2(), values);
+            bool good = values.size() == value_num;
+            for (int j = 0; good && j < value_num; ++j) good = values[j] == i * value_num + j;
+            int value = -1;
+            if (!good || !tree.Get(IdKey((unsigned int) id, value_num - 1), value) || value != i * value_num + value_num - 1) {
+                printf("values of string %d are lost\n", i);
+                ++failed;
+                break;
+            }
+        }
+        BPlusTree<IdKey, int>::TreeStats stats = tree.Analyze();
+        if (stats.ele_num != (long) string_num * value_num || stats.broken_link_num) {
+            printf("tree has %ld eles (want %d), broken links %ld\n", stats.ele_num, string_num * value_num,
+                   stats.broken_link_num);
+            ++failed;
+        }
+    }
+    delete[] ids;
+    RemoveFiles();
+    printf(failed ? "failed\n" : "passed\n");
+    return failed ? 1 : 0;
+}
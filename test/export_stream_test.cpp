@@ -0,0 +1,165 @@
+/*
+ * Import of a truncated or corrupted export stream returns false and leaves the tree empty,
+ * then the good stream is imported into the same tree
+ */
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+
+using namespace std;
+
+const char *tree_name = "export_stream_test_tree";
+const char *list_name = "export_stream_test_list";
+const int ele_num = 20000;
+
+Key EleKey(int i) {
+    char index[64];
+    sprintf(index, "i%04d", i / 7);
+    return Key(index, i);
+}
+
+//import stream into an empty tree, the tree must be empty after if it fails
+int ExpectBroken(const string &stream, const char *what) {
+    remove(tree_name);
+    remove(list_name);
+    BPlusTree<Key, int> tree(tree_name, list_name);
+    istringstream in(stream);
+    if (tree.Import(in)) {
+        printf("%s: imported\n", what);
+        return 1;
+    }
+    BPlusTree<Key, int>::TreeStats stats = tree.Analyze();
+    int value;
+    if (stats.ele_num || stats.height || tree.Get(EleKey(0), value)) {
+        printf("%s: the tree is not empty\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+void PutNumber(string &chunk, unsigned long number) {
+    while (number >= 0x80) {
+        chunk.push_back((char) ((number & 0x7f) | 0x80));
+        number >>= 7;
+    }
+    chunk.push_back((char) number);
+}
+
+//the header, one chunk of ele_num eles coded in bytes, then the end with total
+string Stream(unsigned int chunk_ele_num, const string &bytes, unsigned int byte_num, long long total) {
+    ExportHeader header;
+    header.key_bytes = sizeof(Key);
+    header.value_bytes = sizeof(int);
+    string stream(reinterpret_cast<const char *> (&header), sizeof(header));
+    unsigned int head[2] = {chunk_ele_num, byte_num};
+    stream.append(reinterpret_cast<const char *> (head), sizeof(head));
+    stream += bytes;
+    unsigned int end[2] = {0, 0};
+    stream.append(reinterpret_cast<const char *> (end), sizeof(end));
+    stream.append(reinterpret_cast<const char *> (&total), sizeof(total));
+    return stream;
+}
+
+int main() {
+    int failed = 0;
+    string good;
+    {
+        remove(tree_name);
+        remove(list_name);
+        BPlusTree<Key, int> tree(tree_name, list_name);
+        for (int i = 0; i < ele_num; ++i) tree.Insert(EleKey(i), i);
+        ostringstream out;
+        if (tree.Export(out) != ele_num) ++failed;
+        good = out.str();
+    }
+    //cut anywhere: in the header, a chunk head, a chunk, or the end
+    mt19937 random(7);
+    for (int i = 0; i < 40; ++i) {
+        size_t cut = i < 8 ? (size_t) i * 3 : random() % good.size();
+        failed += ExpectBroken(good.substr(0, cut), "truncated");
+    }
+    failed += ExpectBroken(good.substr(0, good.size() - 1), "truncated in the count");
+    {
+        string bad = good;
+        bad[0] = 'X';
+        failed += ExpectBroken(bad, "bad magic");
+    }
+    {//equal of 2^64-1 and fresh of 1 wrap around to 0
+        string chunk;
+        PutNumber(chunk, ~0ul);
+        PutNumber(chunk, 1);
+        chunk.push_back('a');
+        failed += ExpectBroken(Stream(1, chunk, (unsigned int) chunk.size(), 1), "wrapped run");
+    }
+    {//more new bytes than the chunk holds
+        string chunk;
+        PutNumber(chunk, 0);
+        PutNumber(chunk, sizeof(Key) + sizeof(int));
+        chunk.append(4, 'a');
+        failed += ExpectBroken(Stream(1, chunk, (unsigned int) chunk.size(), 1), "short chunk");
+    }
+    {//a run past the ele
+        string chunk;
+        PutNumber(chunk, 0);
+        PutNumber(chunk, sizeof(Key) + sizeof(int) + 1);
+        chunk.append(sizeof(Key) + sizeof(int) + 1, 'a');
+        failed += ExpectBroken(Stream(1, chunk, (unsigned int) chunk.size(), 1), "long run");
+    }
+    {//bytes left after the last ele of the chunk
+        string chunk;
+        PutNumber(chunk, 0);
+        PutNumber(chunk, sizeof(Key) + sizeof(int));
+        chunk.append(sizeof(Key) + sizeof(int), 'a');
+        chunk.append(3, '\0');
+        failed += ExpectBroken(Stream(1, chunk, (unsigned int) chunk.size(), 1), "trailing bytes");
+    }
+    failed += ExpectBroken(Stream(1, "", 0xfffffff0u, 1), "huge chunk");
+    failed += ExpectBroken(Stream(1u << 20, "", 0, 1), "too many eles in a chunk");
+    {//a whole ele, the count at the end is wrong
+        string chunk;
+        PutNumber(chunk, 0);
+        PutNumber(chunk, sizeof(Key) + sizeof(int));
+        chunk.append(sizeof(Key) + sizeof(int), 'a');
+        failed += ExpectBroken(Stream(1, chunk, (unsigned int) chunk.size(), 2), "wrong count");
+    }
+    //flipped bytes may still decode, a stream rejected leaves the tree empty
+    for (int i = 0; i < 40; ++i) {
+        string bad = good;
+        bad[sizeof(ExportHeader) + random() % (bad.size() - sizeof(ExportHeader))] ^= (char) (1 + random() % 255);
+        remove(tree_name);
+        remove(list_name);
+        BPlusTree<Key, int> tree(tree_name, list_name);
+        istringstream in(bad);
+        if (!tree.Import(in) && tree.Analyze().ele_num) {
+            printf("corrupted: the tree is not empty\n");
+            ++failed;
+        }
+    }
+    {//the same tree takes the good stream after a broken one
+        remove(tree_name);
+        remove(list_name);
+        BPlusTree<Key, int> tree(tree_name, list_name);
+        istringstream broken(good.substr(0, good.size() / 2)), in(good);
+        if (tree.Import(broken) || !tree.Import(in)) ++failed;
+        BPlusTree<Key, int>::TreeStats stats = tree.Analyze();
+        if (stats.ele_num != ele_num || stats.broken_link_num) {
+            printf("imported %ld eles (want %d), broken links %ld\n", stats.ele_num, ele_num, stats.broken_link_num);
+            ++failed;
+        }
+        for (int i = 0; i < ele_num; i += 101) {
+            int value = -1;
+            if (!tree.Get(EleKey(i), value) || value != i) {
+                printf("ele %d is lost\n", i);
+                ++failed;
+                break;
+            }
+        }
+    }
+    remove(tree_name);
+    remove(list_name);
+    printf(failed ? "failed\n" : "passed\n");
+    return failed ? 1 : 0;
+}
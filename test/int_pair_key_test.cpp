@@ -0,0 +1,132 @@
+/*
+ * a BPlusTree<IntPairKey, int> against a std::map: insert, find all seconds of a first,
+ * paged range scans over firsts and over whole pairs, delete half of it, then reopen
+ * firsts and seconds are negative too, the packed order must be the order of int
+ */
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <utility>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+
+using namespace std;
+
+const char *tree_name = "int_pair_key_test_tree";
+const char *list_name = "int_pair_key_test_list";
+const int first_num = 200;
+const int ele_num = 50000;
+
+typedef map<pair<int, int>, int> Reference;
+
+int First(mt19937 &random) {
+    return (int) (random() % first_num) - first_num / 2;
+}
+
+//every ele with lo <= key <= hi under cmp, read page by page
+template<class Compare>
+sjtu::vector<pair<IntPairKey, int>> Scan(BPlusTree<IntPairKey, int> &tree, const IntPairKey &lo,
+                                         const IntPairKey &hi, const Compare &cmp) {
+    sjtu::vector<pair<IntPairKey, int>> eles;
+    BPlusTree<IntPairKey, int>::RangeCursor cursor;
+    do {
+        tree.Range(lo, hi, cmp, 97, eles, cursor);
+    } while (!cursor.done);
+    return eles;
+}
+
+//the eles of reference from lo to the end of hi match what is read, return the number of errors
+int Compare(const sjtu::vector<pair<IntPairKey, int>> &eles, Reference::const_iterator begin,
+            Reference::const_iterator end, const char *what) {
+    size_t i = 0;
+    for (; begin != end; ++begin, ++i) {
+        if (i == eles.size() || eles[i].first.first != begin->first.first ||
+            eles[i].first.second != begin->first.second || eles[i].second != begin->second) {
+            printf("%s: ele %zu differs\n", what, i);
+            return 1;
+        }
+    }
+    if (i != eles.size()) {
+        printf("%s: %zu eles (want %zu)\n", what, eles.size(), i);
+        return 1;
+    }
+    return 0;
+}
+
+//reference and tree hold the same eles, return the number of errors
+int Check(BPlusTree<IntPairKey, int> &tree, const Reference &reference, mt19937 &random) {
+    int failed = 0;
+    BPlusTree<IntPairKey, int>::TreeStats stats = tree.Analyze();
+    if (stats.ele_num != (long) reference.size() || stats.broken_link_num) {
+        printf("tree has %ld eles (want %zu), broken links %ld\n", stats.ele_num, reference.size(),
+               stats.broken_link_num);
+        ++failed;
+    }
+    for (int i = 0; i < 20; ++i) {
+        int first = First(random);
+        sjtu::vector<int> values;
+        tree.Find(IntPairKey(first), pair_cmp2(), values);
+        Reference::const_iterator begin = reference.lower_bound(make_pair(first, INT32_MIN)),
+                end = reference.upper_bound(make_pair(first, INT32_MAX));
+        size_t j = 0;
+        for (Reference::const_iterator iter = begin; iter != end && j < values.size(); ++iter, ++j) {
+            if (values[j] != iter->second) break;
+        }
+        if (j != values.size() || (long) values.size() != distance(begin, end)) {
+            printf("find %d: %zu values differ\n", first, values.size());
+            ++failed;
+        }
+        //all seconds of firsts lo..hi
+        int lo = first, hi = first + (int) (random() % 10);
+        failed += Compare(Scan(tree, IntPairKey(lo), IntPairKey(hi), pair_cmp2()),
+                          reference.lower_bound(make_pair(lo, INT32_MIN)),
+                          reference.upper_bound(make_pair(hi, INT32_MAX)), "range of firsts");
+        //from one pair to another
+        IntPairKey from(lo, (int) random()), to(hi, (int) random());
+        if (to < from) swap(from, to);
+        failed += Compare(Scan(tree, from, to, pair_cmp1()), reference.lower_bound(make_pair(from.first, from.second)),
+                          reference.upper_bound(make_pair(to.first, to.second)), "range of pairs");
+    }
+    return failed;
+}
+
+int main() {
+    remove(tree_name);
+    remove(list_name);
+    mt19937 random(11);
+    Reference reference;
+    int failed = 0;
+    {
+        BPlusTree<IntPairKey, int> tree(tree_name, list_name);
+        for (int i = 0; i < ele_num; ++i) {
+            IntPairKey key(First(random), (int) random());
+            bool inserted = reference.insert(make_pair(make_pair(key.first, key.second), i)).second;
+            if (tree.Insert(key, i) != inserted) ++failed;
+        }
+        failed += Check(tree, reference, random);
+        //delete every other ele
+        bool odd = false;
+        for (Reference::iterator iter = reference.begin(); iter != reference.end();) {
+            odd = !odd;
+            if (!odd) {
+                ++iter;
+                continue;
+            }
+            if (!tree.Delete(IntPairKey(iter->first.first, iter->first.second))) ++failed;
+            int value;
+            if (tree.Get(IntPairKey(iter->first.first, iter->first.second), value)) ++failed;
+            iter = reference.erase(iter);
+        }
+        if (failed) printf("insert or delete failed\n");
+        failed += Check(tree, reference, random);
+    }
+    {
+        BPlusTree<IntPairKey, int> tree(tree_name, list_name);
+        failed += Check(tree, reference, random);
+    }
+    remove(tree_name);
+    remove(list_name);
+    printf(failed ? "failed\n" : "passed\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * lazy deletes leave most blocks under half, one Tidy must leave none (the tree has many blocks)
+ * every ele left is still found, every ele deleted is gone
+ */
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+
+using namespace std;
+
+const char *tree_name = "tidy_test_tree";
+const char *list_name = "tidy_test_list";
+
+void Name(int id, char *index) {
+    sprintf(index, "i%05d", id);
+}
+
+int main() {
+    const int index_num = 1000, ele_num = 100000;
+    remove(tree_name);
+    remove(list_name);
+    mt19937 random(5);
+    Key *keys = new Key[ele_num];
+    int n = 0;
+    int failed = 0;
+    {
+        BPlusTree<Key, int> tree(tree_name, list_name);
+        char index[64];
+        for (int i = 0; i < ele_num; ++i) {
+            Name((int) (random() % index_num), index);
+            Key key(index, (int) (random() % 1000000));
+            if (tree.Insert(key, key.value)) keys[n++] = key;
+        }
+        shuffle(keys, keys + n, random);
+        int deleted = n * 4 / 5;
+        tree.SetLazyDelete(true);
+        for (int i = 0; i < deleted; ++i) {
+            if (!tree.Delete(keys[i])) ++failed;
+        }
+        BPlusTree<Key, int>::TreeStats before = tree.Analyze();
+        long rebalanced = tree.Tidy();
+        BPlusTree<Key, int>::TreeStats after = tree.Analyze();
+        long sparse_before = 0, sparse_after = 0;
+        for (int i = 0; i < 5; ++i) {//under half
+            sparse_before += before.block_fill_histogram[i];
+            sparse_after += after.block_fill_histogram[i];
+        }
+        printf("blocks %ld, %ld under half; Tidy rebalanced %ld: blocks %ld, %ld under half\n",
+               before.block_num, sparse_before, rebalanced, after.block_num, sparse_after);
+        if (after.block_num < 2 || sparse_before == 0) {
+            printf("the test doesn't leave sparse blocks\n");
+            ++failed;
+        }
+        if (sparse_after) ++failed;
+        if (after.ele_num != n - deleted || after.broken_link_num) {
+            printf("eles %ld (want %d), broken links %ld\n", after.ele_num, n - deleted, after.broken_link_num);
+            ++failed;
+        }
+        for (int i = 0; i < n; ++i) {
+            int value;
+            if (tree.Get(keys[i], value) != (i >= deleted)) {
+                printf("ele %d: %s %d is %s\n", i, keys[i].index, keys[i].value, i >= deleted ? "lost" : "not deleted");
+                ++failed;
+                break;
+            }
+        }
+        if (tree.Tidy()) {
+            printf("a second Tidy still rebalances\n");
+            ++failed;
+        }
+    }
+    delete[] keys;
+    remove(tree_name);
+    remove(list_name);
+    printf(failed ? "failed\n" : "passed\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * a process committing batches is killed, while a journal of Commit is on disk, then the trees are reopened
+ * after Recover the trees hold exactly the batches committed, each one whole
+ *
+ * batch k inserts index_num eles of k into a (own files) and into b (in a database),
+ * deletes the eles of batch k-2 from a, and updates "next" to k+1 in both
+ * so with next = k: a holds batches k-2 and k-1, b holds batches 0..k-1
+ */
+#include <cstdio>
+#include <csignal>
+#include <random>
+#include <thread>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "head-file/key.hpp"
+#include "utility/BPlusTree.hpp"
+#include "utility/database.hpp"
+#include "utility/write_batch.hpp"
+
+using namespace std;
+
+const char *tree_name = "write_batch_test_tree";
+const char *list_name = "write_batch_test_list";
+const char *database_name = "write_batch_test_db";
+const char *journal_name = "write_batch_test_journal";
+const int index_num = 3000;
+
+Key BatchKey(int batch, int i) {
+    char index[64];
+    sprintf(index, "b%06d-%05d", batch, i);
+    return Key(index, i);
+}
+
+Key NextKey() {
+    char index[64] = "next";
+    return Key(index);
+}
+
+int Next(BPlusTree<Key, int> &tree) {
+    int next = 0;
+    tree.Get(NextKey(), next);
+    return next;
+}
+
+void RemoveFiles() {
+    remove(tree_name);
+    remove(list_name);
+    remove(database_name);
+    remove(journal_name);
+}
+
+/*
+ * kill itself once the journal has grown past kill_bytes, so it dies in the middle of a Commit
+ * or after batch_num batches, between two of them
+ */
+[[noreturn]] void Child(long kill_bytes, int batch_num) {
+    thread killer([kill_bytes]() {
+        struct stat st;
+        while (true) {
+            if (!stat(journal_name, &st) && st.st_size > kill_bytes) kill(getpid(), SIGKILL);
+            this_thread::yield();
+        }
+    });
+    killer.detach();
+    Database db(database_name, 1L << 20);
+    BPlusTree<Key, int> a(tree_name, list_name), b(db, "b");
+    a.SetMemoryBudget(1L << 16);//pages are evicted, so written, while a batch is applied
+    for (int j = 0; j < batch_num; ++j) {
+        int k = Next(a);
+        WriteBatch batch(journal_name);
+        for (int i = 0; i < index_num; ++i) {
+            batch.Insert(a, BatchKey(k, i), k);
+            batch.Insert(b, BatchKey(k, i), k);
+            if (k >= 2) batch.Delete(a, BatchKey(k - 2, i));
+        }
+        batch.Update(a, NextKey(), k + 1);
+        batch.Update(b, NextKey(), k + 1);
+        batch.Commit();
+    }
+    kill(getpid(), SIGKILL);
+    while (true) pause();
+}
+
+//the trees hold batches [0,next) as they should, return the number of errors
+int Check(int &next) {
+    Database db(database_name, 1L << 20);
+    BPlusTree<Key, int> a(tree_name, list_name), b(db, "b");
+    next = Next(a);
+    int failed = 0;
+    if (Next(b) != next) {
+        printf("next of a is %d, of b is %d\n", next, Next(b));
+        ++failed;
+    }
+    long want_a = 1 + (long) index_num * (next < 2 ? next : 2), want_b = 1 + (long) index_num * next;
+    BPlusTree<Key, int>::TreeStats stats_a = a.Analyze(), stats_b = b.Analyze();
+    if (stats_a.ele_num != want_a || stats_b.ele_num != want_b || stats_a.broken_link_num ||
+        stats_b.broken_link_num) {
+        printf("next %d: a has %ld eles (want %ld), b has %ld (want %ld), broken links %ld %ld\n", next,
+               stats_a.ele_num, want_a, stats_b.ele_num, want_b, stats_a.broken_link_num, stats_b.broken_link_num);
+        ++failed;
+    }
+    for (int k = next - 2 > 0 ? next - 2 : 0; k < next; ++k) {
+        for (int i = 0; i < index_num; i += 97) {
+            int value = -1;
+            if (!a.Get(BatchKey(k, i), value) || value != k || !b.Get(BatchKey(k, i), value) || value != k) {
+                printf("batch %d, ele %d is lost\n", k, i);
+                ++failed;
+                break;
+            }
+        }
+    }
+    return failed;
+}
+
+int main() {
+    RemoveFiles();
+    {//the files exist before the first batch
+        Database db(database_name, 1L << 20);
+        BPlusTree<Key, int> a(tree_name, list_name), b(db, "b");
+        a.Insert(NextKey(), 0);
+        b.Insert(NextKey(), 0);
+    }
+    mt19937 random(3);
+    const int rounds = 12;
+    int failed = 0, undone = 0, next = 0;
+    for (int round = 0; round < rounds && !failed; ++round) {
+        long kill_bytes = 1 + (long) (random() % (768L << 10));//a journal of a batch grows to 150k-660k
+        pid_t pid = fork();
+        if (pid < 0) return 1;
+        if (pid == 0) Child(kill_bytes, 4);
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFSIGNALED(status)) {
+            printf("round %d: the child was not killed\n", round);
+            ++failed;
+            break;
+        }
+        if (WriteBatch::Recover(journal_name)) ++undone;
+        int before = next;
+        failed += Check(next);
+        if (next < before) {
+            printf("round %d: next went back from %d to %d\n", round, before, next);
+            ++failed;
+        }
+        printf("round %d: killed past %ld journal bytes, %d batches committed\n", round, kill_bytes, next);
+    }
+    if (!undone) {
+        printf("no batch was cut\n");
+        ++failed;
+    }
+    RemoveFiles();
+    printf("%d of %d cut batches undone\n", undone, rounds);
+    printf(failed ? "failed\n" : "passed\n");
+    return failed ? 1 : 0;
+}